@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "header.h"
+#include "codec.h"
+
+// number of lines rendered at once, like for the "-d" argument
+#define RENDER_LINES 16
+
+/*
+structure of benchmark options
+
+sizes = side lengths of the generated images
+format = 0 for CSV, 1 for JSON
+*/
+typedef struct bench_options
+{
+    int sizes[16], count;
+    int factor, threads, threshold, repeat;
+    int format;
+} bench_options;
+
+/*
+structure of the results of a benchmark case; times are in milliseconds
+and the fastest run of each phase is kept
+*/
+typedef struct bench_result
+{
+    double read, table, tree, write, encode, load, zload, render;
+    uint32_t nodes, leaves;
+    long bytes, zbytes;
+    long peak_rss;
+} bench_result;
+
+/*
+function used to find the current time in milliseconds
+*/
+static double now_ms (void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+/*
+function used to generate the next value of a deterministic
+pseudo-random sequence (xorshift)
+*/
+static uint32_t next_random (uint32_t *state)
+{
+    uint32_t x = (*state);
+
+    x = x ^ (x << 13);
+    x = x ^ (x >> 17);
+    x = x ^ (x << 5);
+    (*state) = x;
+
+    return x;
+}
+
+/*
+function used to find the value (0..255) of a point of a lattice of
+random values, for a given seed
+*/
+static int lattice (int x, int y, uint32_t seed)
+{
+    uint32_t h = seed ^ ((uint32_t) x * 73856093u) ^ ((uint32_t) y * 19349663u);
+
+    h = (h ^ (h >> 13)) * 1274126177u;
+
+    return (h ^ (h >> 16)) & 0xff;
+}
+
+/*
+function used to find the value of a natural-like (fractal) image at a
+given point, as a sum of octaves of interpolated random values; each
+octave has half the cell size and half the amplitude of the previous one
+*/
+static int fractal (int x, int y, int size, uint32_t seed)
+{
+    int octave = 0, cell = size / 4, amplitude = 128, total = 0, weight = 0;
+
+    for(octave = 0; octave < 8 && cell >= 1; octave++)
+    {
+        int cx = x / cell, cy = y / cell;
+        int fx = x % cell, fy = y % cell;
+        int a = lattice(cx, cy, seed + octave);
+        int b = lattice(cx + 1, cy, seed + octave);
+        int c = lattice(cx, cy + 1, seed + octave);
+        int d = lattice(cx + 1, cy + 1, seed + octave);
+
+        // bilinear interpolation inside the cell
+        int top = a + (b - a) * fx / cell;
+        int bottom = c + (d - c) * fx / cell;
+
+        total = total + amplitude * (top + (bottom - top) * fy / cell);
+        weight = weight + amplitude;
+        amplitude = amplitude / 2;
+        cell = cell / 2;
+    }
+
+    // blocks smaller than 4 pixels only have the random value
+    if(weight == 0)
+        return lattice(x, y, seed);
+
+    return total / weight;
+}
+
+/*
+function used to write a generated .ppm image in a file; the type is
+"flat", "gradient", "noise" or "fractal"
+*/
+static void generate_image (FILE *f, const char *type, int size)
+{
+    int i = 0, j = 0;
+    uint32_t state = 2463534242u;
+    pixel *line = (pixel *) malloc(size * sizeof(pixel));
+
+    fprintf(f, "P6\n%d %d\n255\n", size, size);
+
+    for(i = 0; i < size; i++)
+    {
+        for(j = 0; j < size; j++)
+        {
+            if(strcmp(type, "flat") == 0)
+            {
+                line[j].red = 90;
+                line[j].green = 140;
+                line[j].blue = 200;
+            }
+            else if(strcmp(type, "gradient") == 0)
+            {
+                line[j].red = 255LL * j / (size > 1 ? size - 1 : 1);
+                line[j].green = 255LL * i / (size > 1 ? size - 1 : 1);
+                line[j].blue = 255LL * (i + j) / (size > 1 ? 2 * size - 2 : 1);
+            }
+            else if(strcmp(type, "noise") == 0)
+            {
+                uint32_t r = next_random(&state);
+                line[j].red = r & 0xff;
+                line[j].green = (r >> 8) & 0xff;
+                line[j].blue = (r >> 16) & 0xff;
+            }
+            else
+            {
+                // two fractals, mixed so the colours are correlated
+                int l = fractal(i, j, size, 17), m = fractal(i, j, size, 91);
+                line[j].red = l;
+                line[j].green = (3 * l + m) / 4;
+                line[j].blue = (l + 3 * m) / 4;
+            }
+        }
+        fwrite(line, sizeof(pixel), size, f);
+    }
+
+    free(line);
+}
+
+/*
+function used to keep the fastest time of a phase
+*/
+static void keep_best (double *best, double time)
+{
+    if((*best) < 0 || time < (*best))
+        (*best) = time;
+}
+
+/*
+function used to run all the phases of the tool on a generated image,
+'repeat' times, and keep the fastest time of each phase
+*/
+static void run_case (const char *type, int size, bench_options *opt, ThreadPool *pool, bench_result *res)
+{
+    int run = 0, i = 0;
+    double start = 0;
+    FILE *image = tmpfile(), *out = tmpfile(), *zout = tmpfile();
+    struct rusage usage;
+
+    if(image == NULL || out == NULL || zout == NULL)
+    {
+        perror("tmpfile");
+        exit(1);
+    }
+
+    generate_image(image, type, size);
+    fflush(image);
+
+    res->read = res->table = res->tree = res->write = -1;
+    res->encode = res->load = res->zload = res->render = -1;
+
+    for(run = 0; run < opt->repeat; run++)
+    {
+        Grid grid;
+        SumTable table;
+        QTree tree, loaded, zloaded;
+        View view;
+        int width = 0, height = 0;
+        pixel *lines = NULL;
+
+        init_sum_table(&table);
+        init_QTree(&tree);
+        init_QTree(&loaded);
+        init_QTree(&zloaded);
+
+        // read the pixels matrix
+        rewind(image);
+        start = now_ms();
+        if(build_grid_c(&grid, image) != 0)
+        {
+            fprintf(stderr, "generated image is not valid\n");
+            exit(1);
+        }
+        keep_best(&res->read, now_ms() - start);
+
+        // build the summed-area table
+        start = now_ms();
+        build_sum_table(&table, &grid);
+        keep_best(&res->table, now_ms() - start);
+
+        // build the compression quadtree
+        start = now_ms();
+        if(pool != NULL)
+            build_QTree_c_parallel(&tree, &table, size, opt->factor,
+                                   opt->threshold, pool);
+        else
+            build_QTree_c(&tree, &table, 0, 0, size, opt->factor);
+        keep_best(&res->tree, now_ms() - start);
+
+        // write the legacy compressed file
+        rewind(out);
+        start = now_ms();
+        fwrite(&tree.leaves, sizeof(uint32_t), 1, out);
+        fwrite(&tree.nodes, sizeof(uint32_t), 1, out);
+        fwrite(tree.node_vector, sizeof(QuadtreeNode), tree.nodes, out);
+        fflush(out);
+        keep_best(&res->write, now_ms() - start);
+        res->bytes = ftell(out);
+
+        // write the compact compressed file
+        rewind(zout);
+        start = now_ms();
+        encode_QTree(&tree, size, size, zout);
+        fflush(zout);
+        keep_best(&res->encode, now_ms() - start);
+        res->zbytes = ftell(zout);
+
+        // read both compressed files
+        rewind(out);
+        start = now_ms();
+        load_QTree(&loaded, out, &width, &height);
+        keep_best(&res->load, now_ms() - start);
+
+        rewind(zout);
+        start = now_ms();
+        load_QTree(&zloaded, zout, &width, &height);
+        keep_best(&res->zload, now_ms() - start);
+
+        // render the image, without writing it
+        init_view(&view, &loaded, width, height, 0);
+        start = now_ms();
+        if(pool != NULL)
+        {
+            int count = opt->threads * opt->threshold;
+            lines = (pixel *) malloc((size_t) count * size * sizeof(pixel));
+            for(i = 0; i < size; i = i + count)
+                render_lines_parallel(&loaded, &view, i,
+                                      (size - i < count) ? size - i : count,
+                                      lines, opt->threshold, pool);
+        }
+        else
+        {
+            lines = (pixel *) malloc((size_t) RENDER_LINES * size *
+                                     sizeof(pixel));
+            for(i = 0; i < size; i = i + RENDER_LINES)
+                render_lines(&loaded, &view, i, (size - i < RENDER_LINES) ?
+                             size - i : RENDER_LINES, lines);
+        }
+        keep_best(&res->render, now_ms() - start);
+
+        res->nodes = tree.nodes;
+        res->leaves = tree.leaves;
+
+        free(lines);
+        free_grid(&grid);
+        free_sum_table(&table);
+        free_QTree(&tree);
+        free_QTree(&loaded);
+        free_QTree(&zloaded);
+    }
+
+    // peak resident memory of the process so far, in kilobytes
+    getrusage(RUSAGE_SELF, &usage);
+    res->peak_rss = usage.ru_maxrss;
+
+    fclose(image);
+    fclose(out);
+    fclose(zout);
+}
+
+/*
+function used to print the results of a benchmark case, as a CSV line or
+a JSON object
+*/
+static void print_result (const char *type, int size, bench_options *opt, bench_result *res, int first)
+{
+    double mpix = (double) size * size / 1000000.0;
+    double compress = res->read + res->table + res->tree + res->write;
+    double decompress = res->load + res->render;
+
+    if(opt->format == 0)
+    {
+        if(first)
+            printf("image,size,factor,threads,read_ms,table_ms,tree_ms,"
+                   "write_ms,encode_ms,load_ms,zload_ms,render_ms,"
+                   "compress_mpix_s,decompress_mpix_s,nodes,leaves,bytes,"
+                   "zbytes,peak_rss_kb\n");
+        printf("%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+               "%.1f,%.1f,%u,%u,%ld,%ld,%ld\n",
+               type, size, opt->factor, opt->threads, res->read, res->table,
+               res->tree, res->write, res->encode, res->load, res->zload,
+               res->render, mpix / (compress / 1000.0),
+               mpix / (decompress / 1000.0), res->nodes, res->leaves,
+               res->bytes, res->zbytes, res->peak_rss);
+        return;
+    }
+
+    printf("%s  {\"image\": \"%s\", \"size\": %d, \"factor\": %d, "
+           "\"threads\": %d,\n   \"ms\": {\"read\": %.3f, \"table\": %.3f, "
+           "\"tree\": %.3f, \"write\": %.3f, \"encode\": %.3f, "
+           "\"load\": %.3f, \"zload\": %.3f, \"render\": %.3f},\n"
+           "   \"compress_mpix_s\": %.1f, \"decompress_mpix_s\": %.1f, "
+           "\"nodes\": %u, \"leaves\": %u, \"bytes\": %ld, \"zbytes\": %ld, "
+           "\"peak_rss_kb\": %ld}",
+           first ? "" : ",\n", type, size, opt->factor, opt->threads,
+           res->read, res->table, res->tree, res->write, res->encode,
+           res->load, res->zload, res->render, mpix / (compress / 1000.0),
+           mpix / (decompress / 1000.0), res->nodes, res->leaves, res->bytes,
+           res->zbytes, res->peak_rss);
+}
+
+/*
+function used to read the options of the benchmark; returns -1 if they
+are not valid
+*/
+static int parse_bench_options (int argc, char *argv[], bench_options *opt)
+{
+    int i = 0;
+
+    opt->sizes[0] = 256;
+    opt->sizes[1] = 1024;
+    opt->sizes[2] = 4096;
+    opt->count = 3;
+    opt->factor = 10;
+    opt->threads = 1;
+    opt->threshold = 64;
+    opt->repeat = 3;
+    opt->format = 0;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            opt->factor = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            opt->threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt->threshold = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            opt->repeat = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            opt->format = (strcmp(argv[++i], "json") == 0);
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            // comma separated side lengths, powers of two
+            char *size = strtok(argv[++i], ",");
+            opt->count = 0;
+            while(size != NULL && opt->count < 16)
+            {
+                int value = atoi(size);
+                if(value < 1 || (value & (value - 1)) != 0 || value > 16384)
+                {
+                    fprintf(stderr, "invalid size %s\n", size);
+                    return -1;
+                }
+                opt->sizes[opt->count++] = value;
+                size = strtok(NULL, ",");
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n SIZES] [-f FACTOR] [-j N] "
+                    "[-t SIZE] [-r REPEAT] [-o csv|json]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if(opt->threads < 1)
+        opt->threads = 1;
+    if(opt->threshold < 1)
+        opt->threshold = 1;
+    if(opt->repeat < 1)
+        opt->repeat = 1;
+
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int i = 0, k = 0, first = 1;
+    const char *types[4] = {"flat", "gradient", "noise", "fractal"};
+    bench_options opt;
+    bench_result res;
+    ThreadPool *pool = NULL;
+
+    if(parse_bench_options(argc, argv, &opt) != 0)
+        return 1;
+
+    if(opt.threads > 1)
+        pool = pool_create(opt.threads);
+
+    if(opt.format == 1)
+        printf("[\n");
+
+    for(i = 0; i < opt.count; i++)
+        for(k = 0; k < 4; k++)
+        {
+            run_case(types[k], opt.sizes[i], &opt, pool, &res);
+            print_result(types[k], opt.sizes[i], &opt, &res, first);
+            fflush(stdout);
+            first = 0;
+        }
+
+    if(opt.format == 1)
+        printf("\n]\n");
+
+    if(pool != NULL)
+        pool_destroy(pool);
+
+    return 0;
+}
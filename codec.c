@@ -0,0 +1,1009 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "codec.h"
+
+// probabilities have 11 bits and adapt by 1/32 of the error
+#define PROB_BITS 11
+#define PROB_ONE (1 << PROB_BITS)
+#define PROB_SHIFT 5
+// the range is shifted when it has less than 24 bits
+#define RANGE_TOP (1u << 24)
+
+/*
+structure of binary range coder, used both for encoding and decoding
+
+buffer, length, capacity = encoded bytes
+position = next byte that is read while decoding
+low, range, cache, pending = state of the encoder (the byte that may still
+                             change because of a carry is kept in 'cache',
+                             followed by 'pending' - 1 bytes of 0xff)
+code = state of the decoder
+*/
+typedef struct RangeCoder
+{
+    unsigned char *buffer;
+    size_t length, capacity, position;
+    uint64_t low;
+    uint32_t range, code;
+    unsigned char cache;
+    uint64_t pending;
+} RangeCoder;
+
+/*
+structure of adaptive model of the quadtree nodes
+
+split[level] = probability that a node with a side length of 2^level
+               pixels has no child nodes
+colour[leaf][c] = binary tree of the probabilities of the bits of the
+                  difference between colour c of a node and the one of its
+                  parent, for internal (leaf = 0) and leaf nodes (leaf = 1)
+*/
+typedef struct Model
+{
+    uint16_t split[32];
+    uint16_t colour[2][3][256];
+} Model;
+
+/*
+function used to set all the probabilities of a model to 1/2
+*/
+static void init_model (Model *model)
+{
+    int i = 0;
+
+    for(i = 0; i < 32; i++)
+        model->split[i] = PROB_ONE / 2;
+    for(i = 0; i < 2 * 3 * 256; i++)
+        (&model->colour[0][0][0])[i] = PROB_ONE / 2;
+}
+
+/*
+function used to add a byte at the end of the encoded bytes
+*/
+static void put_byte (RangeCoder *rc, unsigned char byte)
+{
+    if(rc->length == rc->capacity)
+    {
+        rc->capacity = (rc->capacity == 0) ? 4096 : 2 * rc->capacity;
+        rc->buffer = (unsigned char *) realloc(rc->buffer, rc->capacity);
+    }
+
+    rc->buffer[rc->length++] = byte;
+}
+
+/*
+function used to write the top byte of 'low', once it is known that a
+carry cannot change it anymore
+*/
+static void shift_low (RangeCoder *rc)
+{
+    if((uint32_t) rc->low < 0xff000000u || (rc->low >> 32) != 0)
+    {
+        unsigned char carry = rc->low >> 32;
+        unsigned char byte = rc->cache;
+
+        do
+        {
+            put_byte(rc, byte + carry);
+            byte = 0xff;
+        } while(--rc->pending != 0);
+
+        rc->cache = (rc->low >> 24) & 0xff;
+    }
+
+    rc->pending++;
+    rc->low = (rc->low & 0x00ffffffu) << 8;
+}
+
+/*
+function used to initialize a range coder for encoding
+*/
+static void init_encoder (RangeCoder *rc)
+{
+    rc->buffer = NULL;
+    rc->length = 0;
+    rc->capacity = 0;
+    rc->position = 0;
+    rc->low = 0;
+    rc->range = 0xffffffffu;
+    rc->cache = 0;
+    rc->pending = 1;
+}
+
+/*
+function used to encode a bit with a given probability of being 0 and
+adapt the probability
+*/
+static void encode_bit (RangeCoder *rc, uint16_t *prob, int bit)
+{
+    uint32_t bound = (rc->range >> PROB_BITS) * (*prob);
+
+    if(bit == 0)
+    {
+        rc->range = bound;
+        (*prob) = (*prob) + ((PROB_ONE - (*prob)) >> PROB_SHIFT);
+    }
+    else
+    {
+        rc->low = rc->low + bound;
+        rc->range = rc->range - bound;
+        (*prob) = (*prob) - ((*prob) >> PROB_SHIFT);
+    }
+
+    while(rc->range < RANGE_TOP)
+    {
+        rc->range = rc->range << 8;
+        shift_low(rc);
+    }
+}
+
+/*
+function used to write the last bytes of the encoder
+*/
+static void flush_encoder (RangeCoder *rc)
+{
+    int i = 0;
+
+    for(i = 0; i < 5; i++)
+        shift_low(rc);
+}
+
+/*
+function used to read the next encoded byte (0 after the last one)
+*/
+static unsigned char get_byte (RangeCoder *rc)
+{
+    if(rc->position < rc->length)
+        return rc->buffer[rc->position++];
+
+    return 0;
+}
+
+/*
+function used to initialize a range coder for decoding a buffer
+*/
+static void init_decoder (RangeCoder *rc, unsigned char *buffer, size_t length)
+{
+    int i = 0;
+
+    rc->buffer = buffer;
+    rc->length = length;
+    rc->position = 0;
+    rc->range = 0xffffffffu;
+    rc->code = 0;
+
+    for(i = 0; i < 5; i++)
+        rc->code = (rc->code << 8) | get_byte(rc);
+}
+
+/*
+function used to decode a bit with a given probability of being 0 and
+adapt the probability
+*/
+static int decode_bit (RangeCoder *rc, uint16_t *prob)
+{
+    uint32_t bound = (rc->range >> PROB_BITS) * (*prob);
+    int bit = 0;
+
+    if(rc->code < bound)
+    {
+        rc->range = bound;
+        (*prob) = (*prob) + ((PROB_ONE - (*prob)) >> PROB_SHIFT);
+    }
+    else
+    {
+        rc->code = rc->code - bound;
+        rc->range = rc->range - bound;
+        (*prob) = (*prob) - ((*prob) >> PROB_SHIFT);
+        bit = 1;
+    }
+
+    while(rc->range < RANGE_TOP)
+    {
+        rc->range = rc->range << 8;
+        rc->code = (rc->code << 8) | get_byte(rc);
+    }
+
+    return bit;
+}
+
+/*
+function used to encode a byte with a binary tree of probabilities,
+starting with its most significant bit
+*/
+static void encode_byte (RangeCoder *rc, uint16_t *probs, int value)
+{
+    int i = 0, node = 1, bit = 0;
+
+    for(i = 7; i >= 0; i--)
+    {
+        bit = (value >> i) & 1;
+        encode_bit(rc, &probs[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+/*
+function used to decode a byte encoded by 'encode_byte'
+*/
+static int decode_byte (RangeCoder *rc, uint16_t *probs)
+{
+    int i = 0, node = 1;
+
+    for(i = 0; i < 8; i++)
+        node = (node << 1) | decode_bit(rc, &probs[node]);
+
+    return node - 256;
+}
+
+/*
+function used to map the difference between two colours to a byte, so
+the small differences (positive or negative) get small values
+*/
+static int colour_delta (unsigned char colour, unsigned char parent)
+{
+    int delta = (signed char) (unsigned char) (colour - parent);
+
+    return (delta >= 0) ? 2 * delta : -2 * delta - 1;
+}
+
+/*
+function used to find a colour from its difference to the one of its
+parent, as given by 'colour_delta'
+*/
+static unsigned char colour_value (int value, unsigned char parent)
+{
+    int delta = (value & 1) ? -(value + 1) / 2 : value / 2;
+
+    return (unsigned char) (parent + delta);
+}
+
+/*
+function used to encode the nodes of a quadtree, in pre-order: for each
+node, a split bit (only for blocks with more than a pixel of the image) 
+and the differences between its colours and the ones of its parent;
+2^level is the side length of the square covered by the quadtree, in
+which the image starts at the line and the column of the quadtree
+*/
+static void encode_tree (RangeCoder *rc, Model *model, QTree *tree, int level, int width, int height)
+{
+    int leaf = 0, half = 0, top = 0;
+    uint32_t area = 0;
+    QuadtreeNode root = {0, 0, 0, 0, -1, -1, -1, -1};
+    QuadtreeNode *node = NULL, *parent = NULL;
+    Pending stack[QT_STACK], b;
+
+    // 'size' stores the level of the block, and the blocks are in the
+    // coordinates of the image
+    stack[top++] = (Pending) {-tree->line, -tree->column, level, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        node = &tree->node_vector[b.index];
+        parent = (b.parent == -1) ? &root : &tree->node_vector[b.parent];
+        leaf = (node->top_left == -1);
+        area = block_area(b.x, b.y, 1 << b.size, width, height);
+
+        // the blocks outside the image are not coded
+        if(area == 0)
+            continue;
+
+        if(area > 1)
+            encode_bit(rc, &model->split[b.size], !leaf);
+
+        encode_byte(rc, model->colour[leaf][0],
+                    colour_delta(node->red, parent->red));
+        encode_byte(rc, model->colour[leaf][1],
+                    colour_delta(node->green, parent->green));
+        encode_byte(rc, model->colour[leaf][2],
+                    colour_delta(node->blue, parent->blue));
+
+        if(leaf)
+            continue;
+
+        // the children are pushed in reverse order, so they are
+        // encoded in pre-order
+        half = (1 << b.size) / 2;
+        stack[top++] = (Pending) {b.x + half, b.y, b.size - 1, 
+                                  node->bottom_left, b.index, 3};
+        stack[top++] = (Pending) {b.x + half, b.y + half, b.size - 1, 
+                                  node->bottom_right, b.index, 2};
+        stack[top++] = (Pending) {b.x, b.y + half, b.size - 1, 
+                                  node->top_right, b.index, 1};
+        stack[top++] = (Pending) {b.x, b.y, b.size - 1, node->top_left, 
+                                  b.index, 0};
+    }
+}
+
+/*
+function used to verify if the legacy compressed file of an image needs 
+the dimensions record: the image is not a square with a side length that
+is a power of two
+*/
+static int needs_dimensions (int width, int height)
+{
+    return width != height || quadtree_size(width, height) != width;
+}
+
+/*
+function used to verify if the image of a quadtree was moved away from
+the top-left corner of the square of the quadtree by a transform, so its
+compressed file records its line and its column
+*/
+static int moved (QTree *tree)
+{
+    return tree->line != 0 || tree->column != 0;
+}
+
+/*
+function used to verify that the line and the column of the top-left 
+pixel of an image with given dimensions, read from a compressed file, 
+keep the image inside the square of its quadtree; returns 0 on success 
+and -1 if they are not valid
+*/
+int check_origin (uint32_t line, uint32_t column, int width, int height)
+{
+    int size = quadtree_size(width, height);
+
+    if(line > (uint32_t) (size - height) || column > (uint32_t) (size - width))
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to find the size of the dimensions record of the legacy
+compressed file of a quadtree (0 if the image does not need one)
+*/
+static size_t dimensions_size (QTree *tree, int width, int height)
+{
+    if(moved(tree))
+        return 4 + 4 * sizeof(uint32_t);
+    if(needs_dimensions(width, height))
+        return 4 + 2 * sizeof(uint32_t);
+
+    return 0;
+}
+
+/*
+function used to write the dimensions record of a legacy compressed file,
+after its nodes array, if the image needs one; 'line' and 'column' are
+the position of the image in the square of its quadtree
+*/
+void write_dimensions (int width, int height, int line, int column, FILE *g)
+{
+    uint32_t dimensions[4] = {width, height, line, column};
+
+    if(line != 0 || column != 0)
+    {
+        fwrite(QTO_MAGIC, 1, 4, g);
+        fwrite(dimensions, sizeof(uint32_t), 4, g);
+        return;
+    }
+
+    if(!needs_dimensions(width, height))
+        return;
+
+    fwrite(QTD_MAGIC, 1, 4, g);
+    fwrite(dimensions, sizeof(uint32_t), 2, g);
+}
+
+/*
+function used to range code the nodes of a quadtree at the end of the
+buffer of an initialized encoder; 'width' and 'height' are the 
+dimensions of the image
+*/
+static void encode_nodes (RangeCoder *rc, QTree *tree, int width, int height)
+{
+    int level = 0, size = quadtree_size(width, height);
+    Model model;
+
+    while((1 << level) < size)
+        level++;
+
+    init_model(&model);
+    encode_tree(rc, &model, tree, level, width, height);
+    flush_encoder(rc);
+}
+
+/*
+function used to write a quadtree in the compact format; 'width' and
+'height' are the dimensions of the image
+*/
+void encode_QTree (QTree *tree, int width, int height, FILE *g)
+{
+    uint32_t header[6] = {width, height, tree->nodes, tree->leaves, 
+                          tree->line, tree->column};
+    unsigned char version = moved(tree) ? QTZ_MOVED : QTZ_VERSION;
+    RangeCoder rc;
+
+    init_encoder(&rc);
+    encode_nodes(&rc, tree, width, height);
+
+    fwrite(QTZ_MAGIC, 1, 4, g);
+    fwrite(&version, 1, 1, g);
+    fwrite(header, sizeof(uint32_t), moved(tree) ? 6 : 4, g);
+    fwrite(rc.buffer, 1, rc.length, g);
+
+    free(rc.buffer);
+}
+
+/*
+function used to copy the nodes of a quadtree in breadth-first order,
+with the child indices of the new array; first[k] is set to the index of
+the first node of level k; returns the copy and the number of levels
+*/
+static QuadtreeNode *breadth_first (QTree *tree, uint32_t *first, uint32_t *levels)
+{
+    /*
+        the copy is also the queue of the traversal: the node at index
+        'head' is the next one whose children are added, at the end of
+        the queue ('tail'); order[i] = index of node i in the original
+        array
+    */
+
+    uint32_t head = 0, tail = 1, end = 1;
+    uint32_t *order = (uint32_t *) malloc(tree->nodes * sizeof(uint32_t));
+    QuadtreeNode *copy = (QuadtreeNode *) malloc(tree->nodes * 
+                                                 sizeof(QuadtreeNode));
+    QuadtreeNode *node = NULL;
+
+    order[0] = 0;
+    first[0] = 0;
+    (*levels) = 1;
+
+    for(head = 0; head < tail; head++)
+    {
+        // the nodes of the previous level were all visited
+        if(head == end)
+        {
+            first[(*levels)++] = head;
+            end = tail;
+        }
+
+        node = &copy[head];
+        (*node) = tree->node_vector[order[head]];
+        if(node->top_left == -1)
+            continue;
+
+        order[tail] = node->top_left;
+        order[tail + 1] = node->top_right;
+        order[tail + 2] = node->bottom_right;
+        order[tail + 3] = node->bottom_left;
+        node->top_left = tail;
+        node->top_right = tail + 1;
+        node->bottom_right = tail + 2;
+        node->bottom_left = tail + 3;
+        tail = tail + 4;
+    }
+
+    free(order);
+
+    return copy;
+}
+
+/*
+function used to write a quadtree in the progressive format; 'width' 
+and 'height' are the dimensions of the image
+*/
+void write_levels (QTree *tree, int width, int height, FILE *g)
+{
+    uint32_t first[QT_MAX_LEVEL + 2], levels = 0;
+    uint32_t header[7] = {width, height, tree->nodes, tree->leaves, 0, 
+                          tree->line, tree->column};
+    unsigned char version = moved(tree) ? QTL_MOVED : QTL_VERSION;
+    QuadtreeNode *copy = breadth_first(tree, first, &levels);
+
+    header[4] = levels;
+    fwrite(QTL_MAGIC, 1, 4, g);
+    fwrite(&version, 1, 1, g);
+    fwrite(header, sizeof(uint32_t), moved(tree) ? 7 : 5, g);
+    fwrite(first, sizeof(uint32_t), levels, g);
+    fwrite(copy, sizeof(QuadtreeNode), tree->nodes, g);
+
+    free(copy);
+}
+
+/*
+function used to find the size of the compressed file of a quadtree, in
+the legacy or the compact format, without writing it
+*/
+size_t compressed_size (QTree *tree, int width, int height, int compact)
+{
+    size_t length = 0;
+    RangeCoder rc;
+
+    // the numbers of leaf nodes and nodes, the nodes array and
+    // the dimensions record
+    if(!compact)
+        return 2 * sizeof(uint32_t) + tree->nodes * sizeof(QuadtreeNode) +
+               dimensions_size(tree, width, height);
+
+    // the magic value, the version, the header and the encoded nodes
+    init_encoder(&rc);
+    encode_nodes(&rc, tree, width, height);
+    length = 4 + 1 + (moved(tree) ? 6 : 4) * sizeof(uint32_t) + rc.length;
+    free(rc.buffer);
+
+    return length;
+}
+
+/*
+function used to write the compressed file of a quadtree, in one of the
+formats, in a buffer of 'capacity' bytes that is enlarged when it is too
+small; returns the size of the file
+*/
+size_t pack_QTree (QTree *tree, int width, int height, int format, unsigned char **buffer, size_t *capacity)
+{
+    uint32_t header[7] = {width, height, tree->nodes, tree->leaves, 0, 
+                          tree->line, tree->column};
+    uint32_t first[QT_MAX_LEVEL + 2], levels = 0;
+    size_t length = compressed_size(tree, width, height, 0);
+    int fields = 0;
+    unsigned char *p = NULL;
+    QuadtreeNode *copy = NULL;
+    RangeCoder rc;
+
+    if(format == FORMAT_LEVELS)
+    {
+        copy = breadth_first(tree, first, &levels);
+        header[4] = levels;
+        fields = moved(tree) ? 7 : 5;
+        length = 4 + 1 + fields * sizeof(uint32_t) + 
+                 levels * sizeof(uint32_t) + 
+                 tree->nodes * sizeof(QuadtreeNode);
+        if((*capacity) < length)
+        {
+            (*buffer) = (unsigned char *) realloc(*buffer, length);
+            (*capacity) = length;
+        }
+
+        // the same fields as the ones written by "write_levels"
+        p = (*buffer);
+        memcpy(p, QTL_MAGIC, 4);
+        p[4] = moved(tree) ? QTL_MOVED : QTL_VERSION;
+        memcpy(p + 5, header, fields * sizeof(uint32_t));
+        p = p + 5 + fields * sizeof(uint32_t);
+        memcpy(p, first, levels * sizeof(uint32_t));
+        p = p + levels * sizeof(uint32_t);
+        memcpy(p, copy, tree->nodes * sizeof(QuadtreeNode));
+
+        free(copy);
+        return length;
+    }
+
+    if(format == FORMAT_LEGACY)
+    {
+        if((*capacity) < length)
+        {
+            (*buffer) = (unsigned char *) realloc(*buffer, length);
+            (*capacity) = length;
+        }
+
+        // the same fields as the ones written to a file
+        p = (*buffer);
+        memcpy(p, &tree->leaves, sizeof(uint32_t));
+        memcpy(p + 4, &tree->nodes, sizeof(uint32_t));
+        memcpy(p + 8, tree->node_vector, tree->nodes * sizeof(QuadtreeNode));
+        p = p + 8 + tree->nodes * sizeof(QuadtreeNode);
+        if(moved(tree))
+        {
+            memcpy(p, QTO_MAGIC, 4);
+            memcpy(p + 4, header, 2 * sizeof(uint32_t));
+            memcpy(p + 12, header + 5, 2 * sizeof(uint32_t));
+        }
+        else if(needs_dimensions(width, height))
+        {
+            memcpy(p, QTD_MAGIC, 4);
+            memcpy(p + 4, header, 2 * sizeof(uint32_t));
+        }
+
+        return length;
+    }
+
+    // the nodes are encoded directly in the buffer, after the
+    // space of the magic value, the version and the header
+    fields = moved(tree) ? 6 : 4;
+    header[4] = tree->line;
+    header[5] = tree->column;
+    length = 4 + 1 + fields * sizeof(uint32_t);
+    if((*capacity) < length)
+    {
+        (*buffer) = (unsigned char *) realloc(*buffer, 4096);
+        (*capacity) = 4096;
+    }
+
+    init_encoder(&rc);
+    rc.buffer = (*buffer);
+    rc.capacity = (*capacity);
+    rc.length = length;
+    encode_nodes(&rc, tree, width, height);
+
+    memcpy(rc.buffer, QTZ_MAGIC, 4);
+    rc.buffer[4] = moved(tree) ? QTZ_MOVED : QTZ_VERSION;
+    memcpy(rc.buffer + 5, header, fields * sizeof(uint32_t));
+
+    (*buffer) = rc.buffer;
+    (*capacity) = rc.capacity;
+
+    return rc.length;
+}
+
+/*
+function used to decode the nodes of a quadtree, in pre-order, adding
+them to the empty nodes array; 2^level is the side length of the square
+covered by the quadtree, in which the image starts at the line and the 
+column of the quadtree; returns -1 if the array would have more nodes 
+than its capacity
+*/
+static int decode_tree (RangeCoder *rc, Model *model, QTree *tree, int level, int width, int height)
+{
+    int leaf = 0, half = 0, top = 0;
+    uint32_t index = 0, area = 0;
+    QuadtreeNode root = {0, 0, 0, 0, -1, -1, -1, -1};
+    QuadtreeNode *node = NULL, *parent = NULL;
+    Pending stack[QT_STACK], b;
+
+    // 'size' stores the level of the block, and the blocks are in the
+    // coordinates of the image
+    stack[top++] = (Pending) {-tree->line, -tree->column, level, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        index = tree->nodes;
+        area = block_area(b.x, b.y, 1 << b.size, width, height);
+
+        if(index >= tree->capacity)
+            return -1;
+
+        // the nodes follow each other in pre-order
+        tree->nodes++;
+        node = &tree->node_vector[index];
+        node->top_left = node->top_right = -1;
+        node->bottom_right = node->bottom_left = -1;
+        node->area = area;
+        if(b.parent != -1)
+            set_child(&tree->node_vector[b.parent], b.child, index);
+
+        // a block outside the image is a black leaf node with no pixels
+        if(area == 0)
+        {
+            node->red = node->green = node->blue = 0;
+            tree->leaves++;
+            continue;
+        }
+
+        leaf = 1;
+        if(area > 1)
+            leaf = !decode_bit(rc, &model->split[b.size]);
+
+        parent = (b.parent == -1) ? &root : &tree->node_vector[b.parent];
+        node->red = colour_value(decode_byte(rc, model->colour[leaf][0]),
+                                 parent->red);
+        node->green = colour_value(decode_byte(rc, model->colour[leaf][1]),
+                                   parent->green);
+        node->blue = colour_value(decode_byte(rc, model->colour[leaf][2]),
+                                  parent->blue);
+
+        if(leaf)
+        {
+            tree->leaves++;
+            continue;
+        }
+
+        half = (1 << b.size) / 2;
+        stack[top++] = (Pending) {b.x + half, b.y, b.size - 1, 0, index, 3};
+        stack[top++] = (Pending) {b.x + half, b.y + half, b.size - 1, 0, 
+                                  index, 2};
+        stack[top++] = (Pending) {b.x, b.y + half, b.size - 1, 0, index, 1};
+        stack[top++] = (Pending) {b.x, b.y, b.size - 1, 0, index, 0};
+    }
+
+    return 0;
+}
+
+/*
+function used to read the rest of a file in an allocated buffer
+*/
+static unsigned char *read_rest (FILE *f, size_t *length)
+{
+    size_t capacity = 1 << 16, count = 0;
+    unsigned char *buffer = (unsigned char *) malloc(capacity);
+
+    (*length) = 0;
+    while((count = fread(buffer + (*length), 1, capacity - (*length), f)) > 0)
+    {
+        (*length) = (*length) + count;
+        if((*length) == capacity)
+        {
+            capacity = 2 * capacity;
+            buffer = (unsigned char *) realloc(buffer, capacity);
+        }
+    }
+
+    return buffer;
+}
+
+/*
+function used to find the number of nodes that are stored in the rest of
+a file, so a damaged header does not allocate more; returns 'count' if
+the file cannot be measured (for example, a pipe)
+*/
+static uint32_t nodes_left (FILE *f, uint32_t count)
+{
+    off_t position = ftello(f), end = 0;
+
+    if(position < 0 || fseeko(f, 0, SEEK_END) != 0)
+        return count;
+    end = ftello(f);
+    if(fseeko(f, position, SEEK_SET) != 0 || end < position)
+        return count;
+
+    if((uint64_t) (end - position) / sizeof(QuadtreeNode) < count)
+        return (end - position) / sizeof(QuadtreeNode);
+
+    return count;
+}
+
+/*
+function used to verify that the nodes array read from a legacy
+compressed file is the quadtree of an image with given dimensions, at
+the line and the column of the quadtree (see "check_block") and has the number of leaf nodes of the file; returns 0 
+on success and -1 if the nodes array is not valid
+*/
+static int check_nodes (QTree *tree, int width, int height)
+{
+    uint32_t leaves = 0;
+
+    if(check_block(tree->node_vector, tree->nodes, -tree->line, 
+                   -tree->column, quadtree_size(width, height), width, 
+                   height, &leaves) != 0 || leaves != tree->leaves)
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to read the rest of a compressed file in the progressive
+format, after its magic value; a file that ends before its last node 
+gives the quadtree of the nodes that were received; returns 0 on success 
+and -1 if the file is not valid
+*/
+static int load_levels (QTree *tree, FILE *f, int *width, int *height)
+{
+    /*
+        the children of the nodes follow each other in breadth-first
+        order, so the children of every internal node have to start at
+        the first index that is not a child of a previous node ('next')
+        and be inside the next level; a node whose children were not all
+        received becomes a leaf node, and so do the following internal
+        nodes, so the nodes from the first child of the first one are 
+        not used ('kept')
+    */
+
+    uint32_t header[7], first[QT_MAX_LEVEL + 2];
+    uint32_t i = 0, count = 0, kept = 0, next = 1, leaves = 0, level = 0;
+    unsigned char version = 0;
+    QuadtreeNode *node = NULL;
+    int size = 0;
+
+    if(fread(&version, 1, 1, f) != 1 || 
+       (version != QTL_VERSION && version != QTL_MOVED) ||
+       fread(header, sizeof(uint32_t), 5, f) != 5)
+        return -1;
+    header[5] = header[6] = 0;
+    if(version == QTL_MOVED && fread(header + 5, sizeof(uint32_t), 2, f) != 2)
+        return -1;
+
+    // the quadtree covers at most 2^QT_MAX_LEVEL * 2^QT_MAX_LEVEL pixels,
+    // and its levels end with the blocks of a single pixel
+    if(header[0] == 0 || header[0] > (1u << QT_MAX_LEVEL) || 
+       header[1] == 0 || header[1] > (1u << QT_MAX_LEVEL))
+        return -1;
+    (*width) = header[0];
+    (*height) = header[1];
+    size = quadtree_size(*width, *height);
+    if(check_origin(header[5], header[6], *width, *height) != 0)
+        return -1;
+    tree->line = header[5];
+    tree->column = header[6];
+    if(header[2] == 0 || header[2] > (4ull * size * size - 1) / 3 ||
+       header[4] == 0 || header[4] > QT_MAX_LEVEL + 1 ||
+       (size >> (header[4] - 1)) == 0 ||
+       fread(first, sizeof(uint32_t), header[4], f) != header[4])
+        return -1;
+
+    // the levels start with the root and are not empty
+    first[header[4]] = header[2];
+    for(i = 0; i < header[4]; i++)
+        if(first[i] >= first[i + 1] || (i == 0 && first[i] != 0))
+            return -1;
+
+    // a file that ends early only needs the nodes it stores
+    count = nodes_left(f, header[2]);
+    if(count == 0 || reserve_QTree(tree, count) != 0)
+        return -1;
+    count = fread(tree->node_vector, sizeof(QuadtreeNode), count, f);
+    if(count == 0)
+        return -1;
+
+    kept = count;
+    for(i = 0; i < kept; i++)
+    {
+        while(i >= first[level + 1])
+            level++;
+
+        node = &tree->node_vector[i];
+        if(node->top_left == -1)
+        {
+            if(node->top_right != -1 || node->bottom_right != -1 ||
+               node->bottom_left != -1)
+                return -1;
+            leaves++;
+            continue;
+        }
+
+        if(node->top_left != (int32_t) next || 
+           node->top_right != (int32_t) next + 1 ||
+           node->bottom_right != (int32_t) next + 2 || 
+           node->bottom_left != (int32_t) next + 3 ||
+           level + 1 == header[4] || next < first[level + 1] ||
+           next + 3 >= first[level + 2])
+            return -1;
+
+        // the children were not all received
+        if(next + 3 >= count)
+        {
+            node->top_left = node->top_right = -1;
+            node->bottom_right = node->bottom_left = -1;
+            leaves++;
+            if(next < kept)
+                kept = next;
+        }
+        next = next + 4;
+    }
+
+    // a complete file has no other nodes than the children of its 
+    // internal nodes
+    if(count == header[2] && (next != count || leaves != header[3]))
+        return -1;
+
+    tree->nodes = kept;
+    tree->leaves = leaves;
+
+    return 0;
+}
+
+/*
+function used to read a compressed file, in the legacy format (the nodes
+array), in the compact one or in the progressive one, and find the
+dimensions of the image; returns 0 on success and -1 if the file is not
+valid
+*/
+int load_QTree (QTree *tree, FILE *f, int *width, int *height)
+{
+    uint32_t header[6];
+    unsigned char magic[4], version = 0;
+    unsigned long long total_area = 0;
+
+    // the image is in the top-left corner of the square, unless the
+    // file records where a transform moved it
+    tree->line = 0;
+    tree->column = 0;
+    if(fread(magic, 1, 4, f) != 4)
+        return -1;
+
+    // compact format
+    if(memcmp(magic, QTZ_MAGIC, 4) == 0)
+    {
+        int level = 0, result = 0, size = 0;
+        size_t length = 0;
+        unsigned char *buffer = NULL;
+        RangeCoder rc;
+        Model model;
+
+        if(fread(&version, 1, 1, f) != 1 || 
+           (version != QTZ_VERSION && version != QTZ_MOVED) ||
+           fread(header, sizeof(uint32_t), 4, f) != 4)
+            return -1;
+        header[4] = header[5] = 0;
+        if(version == QTZ_MOVED && 
+           fread(header + 4, sizeof(uint32_t), 2, f) != 2)
+            return -1;
+
+        // the quadtree covers at most 2^QT_MAX_LEVEL * 2^QT_MAX_LEVEL pixels
+        if(header[0] == 0 || header[0] > (1u << QT_MAX_LEVEL) || 
+           header[1] == 0 || header[1] > (1u << QT_MAX_LEVEL) ||
+           check_origin(header[4], header[5], header[0], header[1]) != 0)
+            return -1;
+        (*width) = header[0];
+        (*height) = header[1];
+        tree->line = header[4];
+        tree->column = header[5];
+        size = quadtree_size(*width, *height);
+        if(header[2] == 0 || header[2] > (4ull * size * size - 1) / 3)
+            return -1;
+        while((1 << level) < size)
+            level++;
+
+        if(reserve_QTree(tree, header[2]) != 0)
+            return -1;
+        tree->nodes = 0;
+        tree->leaves = 0;
+
+        buffer = read_rest(f, &length);
+        init_decoder(&rc, buffer, length);
+        init_model(&model);
+        result = decode_tree(&rc, &model, tree, level, *width, *height);
+        free(buffer);
+
+        if(result != 0 || tree->nodes != header[2] ||
+           tree->leaves != header[3])
+            return -1;
+
+        return 0;
+    }
+
+    // progressive format
+    if(memcmp(magic, QTL_MAGIC, 4) == 0)
+        return load_levels(tree, f, width, height);
+
+    // legacy format: the number of leaf nodes, the total number of
+    // nodes and the nodes array
+    memcpy(&tree->leaves, magic, 4);
+    if(fread(&tree->nodes, sizeof(uint32_t), 1, f) != 1 || tree->nodes == 0)
+        return -1;
+
+    // the quadtree of the largest image has (4 * size^2 - 1) / 3 nodes,
+    // and the nodes array cannot be longer than the file
+    if(tree->nodes > ((4ull << (2 * QT_MAX_LEVEL)) - 1) / 3 ||
+       nodes_left(f, tree->nodes) != tree->nodes ||
+       reserve_QTree(tree, tree->nodes) != 0 ||
+       fread(tree->node_vector, sizeof(QuadtreeNode), tree->nodes, f) !=
+       tree->nodes)
+    {
+        tree->nodes = 0;
+        return -1;
+    }
+
+    // read the dimensions of the image (and its position in the square,
+    // for a moved image) from its record; without it, the image is a 
+    // square with the area of the root, and its side length is a power 
+    // of two
+    if(fread(magic, 1, 4, f) == 4 && (memcmp(magic, QTD_MAGIC, 4) == 0 ||
+                                      memcmp(magic, QTO_MAGIC, 4) == 0))
+    {
+        header[2] = header[3] = 0;
+        if(fread(header, sizeof(uint32_t), 2, f) != 2 || header[0] == 0 ||
+           header[0] > (1u << QT_MAX_LEVEL) || header[1] == 0 || 
+           header[1] > (1u << QT_MAX_LEVEL) ||
+           (memcmp(magic, QTO_MAGIC, 4) == 0 &&
+            fread(header + 2, sizeof(uint32_t), 2, f) != 2) ||
+           check_origin(header[2], header[3], header[0], header[1]) != 0)
+            return -1;
+
+        (*width) = header[0];
+        (*height) = header[1];
+        tree->line = header[2];
+        tree->column = header[3];
+    }
+    else
+    {
+        total_area = tree->node_vector[0].area;
+        if(total_area == 0 || total_area > (1ull << (2 * QT_MAX_LEVEL)))
+            return -1;
+        (*width) = sqrt(total_area);
+        (*height) = (*width);
+        if((unsigned long long) (*width) * (*width) != total_area ||
+           quadtree_size(*width, *height) != (*width))
+            return -1;
+    }
+
+    // verify the child indices, the depth and the areas of the nodes
+    if(check_nodes(tree, *width, *height) != 0)
+        return -1;
+
+    return 0;
+}
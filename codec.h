@@ -0,0 +1,81 @@
+#ifndef CODEC_H
+#define CODEC_H
+#include "header.h"
+
+/*
+compact compressed file ("-z" option)
+
+the file starts with the 4 bytes of QTZ_MAGIC; read as the number of leaf
+nodes of the legacy format, they give a value that is not a multiple of
+3 plus 1, which no quadtree has, so the two formats cannot be confused
+
+header (after the magic): version (1 byte), width, height, number of
+nodes and number of leaf nodes (4 bytes each); then the range coded
+nodes, in pre-order (the nodes of the blocks outside the image are not
+coded, since the decoder knows where they are)
+
+an image moved away from the top-left corner of the square of its
+quadtree by a transform ("-x") has version QTZ_MOVED, and its header is
+followed by the line and the column of its top-left pixel in the square
+(4 bytes each)
+*/
+#define QTZ_MAGIC "\x89QTZ"
+#define QTZ_VERSION 1
+#define QTZ_MOVED 2
+
+/*
+dimensions record of the legacy compressed file
+
+the legacy format only has the nodes array, from which the image is
+taken to be a square; if it is not a square with a side length that is
+a power of two, the nodes array is followed by the 4 bytes of QTD_MAGIC,
+its width and its height (4 bytes each); an image moved away from the
+top-left corner of the square by a transform has instead the 4 bytes of
+QTO_MAGIC, its width, its height and the line and the column of its
+top-left pixel in the square (4 bytes each)
+*/
+#define QTD_MAGIC "\x89QTD"
+#define QTO_MAGIC "\x89QTO"
+
+/*
+progressive compressed file ("-p" option)
+
+the file starts with the 4 bytes of QTL_MAGIC (which, like QTZ_MAGIC, is
+not a possible number of leaf nodes), a version (1 byte), width, height,
+number of nodes, number of leaf nodes and number of levels (4 bytes 
+each), then the index of the first node of each level (4 bytes each) and
+the nodes array in breadth-first order: the root, the nodes of the second
+level, and so on, with the four children of every node next to each 
+other (top-left, top-right, bottom-right, bottom-left)
+
+every node stores the mean colours of its block, so any prefix of the 
+file is a quadtree of a coarser image: the nodes whose children were not
+received yet are used as leaf nodes
+
+like for the compact format, an image moved by a transform has version
+QTL_MOVED, and the line and the column of its top-left pixel in the
+square follow the number of levels
+*/
+#define QTL_MAGIC "\x89QTL"
+#define QTL_VERSION 1
+#define QTL_MOVED 2
+
+/*
+formats of the compressed files
+*/
+enum
+{
+    FORMAT_LEGACY,
+    FORMAT_COMPACT,
+    FORMAT_LEVELS
+};
+
+int check_origin (uint32_t line, uint32_t column, int width, int height);
+void write_dimensions (int width, int height, int line, int column, FILE *g);
+void encode_QTree (QTree *tree, int width, int height, FILE *g);
+void write_levels (QTree *tree, int width, int height, FILE *g);
+size_t compressed_size (QTree *tree, int width, int height, int compact);
+size_t pack_QTree (QTree *tree, int width, int height, int format, unsigned char **buffer, size_t *capacity);
+int load_QTree (QTree *tree, FILE *f, int *width, int *height);
+
+#endif
@@ -3,86 +3,388 @@
 #include <string.h>
 #include <inttypes.h>
 #include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "header.h"
+#include "kernels.h"
+#include "codec.h"
+#include "ppm.h"
 
 /*
-function used to initialize a quadtree
+function used to find the side length of the square covered by the
+quadtree of an image: the smallest power of two that is not less than
+its dimensions
 */
-void init_QTree (QTree **tree)
+int quadtree_size (int width, int height)
 {
-    // allocate root node
-    (*tree) = (QTree*) malloc(sizeof(QTree));
+    int size = 1;
 
-    // initialize pointers to child nodes
-    (*tree)->q1 = NULL;
-    (*tree)->q2 = NULL;
-    (*tree)->q3 = NULL;
-    (*tree)->q4 = NULL;
+    while(size < width || size < height)
+        size = size * 2;
 
-    // initialize colours
-    (*tree)->red = 0;
-    (*tree)->green = 0;
-    (*tree)->blue = 0;
+    return size;
 }
 
 /*
-recursive function used to build compression quadtree based on the
-pixels matrix of the image and the compression factor 
+function used to find the number of elements of [start, start + size)
+that are also in [0, limit); 'start' is negative for the blocks of an 
+image that does not start at the corner of the square of its quadtree
 */
-void build_QTree_c (QTree *tree, pixel **grid, int x, int y, int size, int factor)
+static int clip_length (int start, int size, int limit)
 {
-    /*
-        for each call, the function covers the block that has grid[x][y] 
-        as top-left element and a side length of 'size' pixels
-    */
+    if(start < 0)
+    {
+        size = size + start;
+        start = 0;
+    }
+    if(size <= 0 || start >= limit)
+        return 0;
+
+    return (start + size < limit) ? size : limit - start;
+}
+
+/*
+function used to find the number of pixels of an image with given
+dimensions that are inside the block that has grid[x][y] as top-left
+element and a side length of 'size' pixels
+*/
+uint32_t block_area (int x, int y, int size, int width, int height)
+{
+    return (uint32_t) clip_length(x, size, height) * 
+           clip_length(y, size, width);
+}
+
+/*
+function used to initialize an empty quadtree
+*/
+void init_QTree (QTree *tree)
+{
+    tree->node_vector = NULL;
+    tree->nodes = 0;
+    tree->leaves = 0;
+    tree->capacity = 0;
+    tree->line = 0;
+    tree->column = 0;
+}
+
+/*
+function used to make sure the nodes array of a quadtree can store at
+least 'capacity' nodes; returns 0 on success and -1 if the memory cannot
+be allocated (the nodes array is then unchanged)
+*/
+int reserve_QTree (QTree *tree, uint32_t capacity)
+{
+    QuadtreeNode *node_vector = NULL;
+
+    if(capacity <= tree->capacity)
+        return 0;
+
+    node_vector = (QuadtreeNode *) realloc(tree->node_vector,
+                                           (size_t) capacity * 
+                                           sizeof(QuadtreeNode));
+    if(node_vector == NULL)
+        return -1;
+
+    tree->node_vector = node_vector;
+    tree->capacity = capacity;
+
+    return 0;
+}
+
+/*
+function used to free a quadtree (its nodes array)
+*/
+void free_QTree (QTree *tree)
+{
+    free(tree->node_vector);
+    init_QTree(tree);
+}
+
+/*
+function used to verify that an array of 'count' nodes is the quadtree
+of the block of 'size' pixels whose top-left element is at line x and
+column y of an image with given dimensions (negative when the image is 
+not at the corner of the block): every node, except the root, is the 
+child of a single node, a node has either four children or none, only 
+the blocks of more than one pixel are divided and the area of every node
+is the one of the part of its block inside the image; the number of leaf nodes is stored in
+'leaves'; returns 0 on success and -1 if the nodes array is not valid
+*/
+int check_block (QuadtreeNode *nodes, uint32_t count, int x, int y, int size, int width, int height, uint32_t *leaves)
+{
+    int top = 0, k = 0, half = 0;
+    uint32_t visited = 0;
+    int32_t child[4];
+    unsigned char *seen = NULL;
+    QuadtreeNode *node = NULL;
+    Pending stack[QT_STACK], b;
+
+    (*leaves) = 0;
+    if(count == 0)
+        return -1;
+
+    seen = (unsigned char *) calloc(count, 1);
+    if(seen == NULL)
+        return -1;
+    stack[top++] = (Pending) {x, y, size, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+
+        // a node that was already reached has more than a parent
+        // (or is part of a cycle)
+        if(seen[b.index])
+            break;
+        seen[b.index] = 1;
+        visited++;
+
+        node = &nodes[b.index];
+        if(node->area != block_area(b.x, b.y, b.size, width, height))
+            break;
+
+        child[0] = node->top_left;
+        child[1] = node->top_right;
+        child[2] = node->bottom_right;
+        child[3] = node->bottom_left;
+
+        if(child[0] == -1)
+        {
+            if(child[1] != -1 || child[2] != -1 || child[3] != -1)
+                break;
+            (*leaves)++;
+            continue;
+        }
+
+        // a block of a single pixel is not divided, so the quadtree
+        // is not deeper than the one of the block
+        if(b.size == 1)
+            break;
+
+        half = b.size / 2;
+        for(k = 0; k < 4; k++)
+            if(child[k] <= 0 || (uint32_t) child[k] >= count)
+                break;
+        if(k < 4)
+            break;
+
+        stack[top++] = (Pending) {b.x + half, b.y, half, child[3], -1, 0};
+        stack[top++] = (Pending) {b.x + half, b.y + half, half, child[2], 
+                                  -1, 0};
+        stack[top++] = (Pending) {b.x, b.y + half, half, child[1], -1, 0};
+        stack[top++] = (Pending) {b.x, b.y, half, child[0], -1, 0};
+    }
+    free(seen);
+
+    // every node is reached from the root
+    if(top > 0 || visited != count)
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to add a node at the end of the nodes array of a quadtree
+and return its index; the array doubles its capacity when it is full
+*/
+static int add_node (QTree *tree)
+{
+    if(tree->nodes == tree->capacity)
+        reserve_QTree(tree, tree->capacity == 0 ? 64 : 2 * tree->capacity);
+
+    tree->nodes++;
+
+    return tree->nodes - 1;
+}
+
+/*
+function used to mark a node as a leaf node
+*/
+static void set_leaf (QTree *tree, int index)
+{
+    tree->node_vector[index].top_left = -1;
+    tree->node_vector[index].top_right = -1;
+    tree->node_vector[index].bottom_right = -1;
+    tree->node_vector[index].bottom_left = -1;
+    tree->leaves++;
+}
+
+/*
+function used to initialize an empty summed-area table
+*/
+void init_sum_table (SumTable *table)
+{
+    table->width = 0;
+    table->height = 0;
+    table->capacity = 0;
+    table->entry = NULL;
+}
+
+/*
+function used to build the summed-area table of the pixels matrix, so the
+colour sums of any block can be found with four table lookups; the memory
+of the table is reused if it is large enough
+*/
+void build_sum_table (SumTable *table, Grid *grid)
+{
+    int i = 0;
+    int width = grid->width, height = grid->height;
+    size_t count = (size_t) (width + 1) * (height + 1);
+    line_kernel sum_line = select_line_kernel();
+
+    table->width = width;
+    table->height = height;
+
+    // allocate table, which has an extra zero line and column
+    if(count > table->capacity)
+    {
+        free(table->entry);
+        table->entry = (moments *) malloc(count * sizeof(moments));
+        table->capacity = count;
+    }
+    memset(table->entry, 0, (width + 1) * sizeof(moments));
+
+    // each line adds its own sums to the ones of the lines above;
+    // the kernel is chosen based on the instructions of the processor
+    for(i = 0; i < height; i++)
+        sum_line(grid_line(grid, i), width,
+                 &table->entry[(size_t) i * (width + 1)],
+                 &table->entry[(size_t) (i + 1) * (width + 1)]);
+}
+
+/*
+function used to free a summed-area table
+*/
+void free_sum_table (SumTable *table)
+{
+    free(table->entry);
+    init_sum_table(table);
+}
+
+/*
+function used to find the colour sums of the rectangle that has grid[x][y]
+as top-left element, 'lines' lines and 'columns' columns
+*/
+static void block_moments (SumTable *table, int x, int y, int lines, int columns, moments *block)
+{
+    size_t line = table->width + 1;
+    moments *a = &table->entry[x * line + y];
+    moments *b = &table->entry[x * line + y + columns];
+    moments *c = &table->entry[(x + lines) * line + y];
+    moments *d = &table->entry[(x + lines) * line + y + columns];
+
+    block->red = d->red - b->red - c->red + a->red;
+    block->green = d->green - b->green - c->green + a->green;
+    block->blue = d->blue - b->blue - c->blue + a->blue;
+    block->sq = d->sq - b->sq - c->sq + a->sq;
+}
+
+/*
+function used to find the colour sums of the part of the block that has
+grid[x][y] as top-left element and a side length of 'size' pixels which
+is inside the image; returns the number of pixels of that part
+*/
+static unsigned long long block_sums (SumTable *table, int x, int y, int size, moments *block)
+{
+    int lines = clip_length(x, size, table->height);
+    int columns = clip_length(y, size, table->width);
+
+    // a block outside the image has no pixels
+    if(lines == 0 || columns == 0)
+    {
+        block->red = block->green = block->blue = block->sq = 0;
+        return 0;
+    }
+
+    block_moments(table, x, y, lines, columns, block);
 
-    int i = 0, j = 0;
+    return (unsigned long long) lines * columns;
+}
 
+/*
+function used to assign the mean colours of a block to a node and
+calculate the squared error of the block (the sum of the squared
+differences between its colour values and the mean ones) from its colour
+sums and its number of pixels ('area'); a block with no pixels is black
+*/
+static unsigned long long block_error (QuadtreeNode *node, moments *block, unsigned long long area)
+{
     // medie_culoare = arithmetic mean of values that correspond to
     //                 that colour inside the current block
-    // mean = similarity score for the current block
-    unsigned long long medie_red = 0, medie_green = 0, medie_blue = 0;
+    unsigned long long medie_red = (area > 0) ? block->red / area : 0;
+    unsigned long long medie_green = (area > 0) ? block->green / area : 0;
+    unsigned long long medie_blue = (area > 0) ? block->blue / area : 0;
     unsigned long long mean = 0;
 
-    // sum values corresponding to each colour
-    for(i = x; i < (x + size); i++)
-        for(j = y; j < (y + size); j++)
-        {
-            medie_red = medie_red + grid[i][j].red;
-            medie_green = medie_green + grid[i][j].green;
-            medie_blue = medie_blue + grid[i][j].blue;
-        }
-
-    // divide by the number of pixels to obtain the mean
-    medie_red = medie_red / (size * size);
-    medie_green = medie_green / (size * size);
-    medie_blue = medie_blue / (size * size);
-
-    // assign means to current node
-    tree->red = medie_red;
-    tree->green = medie_green;
-    tree->blue = medie_blue;
-
-    // calculate value of similarity score
-    for(i = x; i < (x + size); i++)
-        for(j = y; j < (y + size); j++)
-        {
-            mean = mean + 
-                   (medie_red - grid[i][j].red) * 
-                   (medie_red - grid[i][j].red);
-            mean = mean + 
-                   (medie_green - grid[i][j].green) * 
-                   (medie_green - grid[i][j].green);
-            mean = mean + 
-                   (medie_blue - grid[i][j].blue) * 
-                   (medie_blue - grid[i][j].blue);
-        }
-    mean = mean / (3 * size * size);
-  
-    // verify if the current block can be divided into quarters
-    if(size > 1)
-        // verify if similarity score is greater than compression factor
-        if(mean > factor)
+    node->red = medie_red;
+    node->green = medie_green;
+    node->blue = medie_blue;
+    node->area = area;
+
+    // the sum of (medie - value)^2 over the block is equal to
+    // sq - 2 * medie * sum + area * medie^2, for each colour
+    mean = block->sq;
+    mean = mean - 2 * medie_red * block->red + area * medie_red * medie_red;
+    mean = mean - 2 * medie_green * block->green + 
+           area * medie_green * medie_green;
+    mean = mean - 2 * medie_blue * block->blue + 
+           area * medie_blue * medie_blue;
+
+    return mean;
+}
+
+/*
+function used to assign the mean colours of a block to a node and
+calculate the similarity score of the block (its mean squared error) 
+from its colour sums and its number of pixels; a block with no pixels 
+has a score of 0
+*/
+static unsigned long long block_score (QuadtreeNode *node, moments *block, unsigned long long area)
+{
+    unsigned long long error = block_error(node, block, area);
+
+    return (area > 0) ? error / (3 * area) : 0;
+}
+
+/*
+function used to build compression quadtree based on the summed-area
+table of the image and the compression factor; the nodes are added 
+directly to the nodes array, in pre-order
+*/
+void build_QTree_c (QTree *tree, SumTable *table, int x, int y, int size, int factor)
+{
+    /*
+        the blocks waiting to be covered are kept in a stack; each block
+        has grid[x][y] as top-left element and a side length of 'size'
+        pixels, clipped to the image
+    */
+
+    // mean = similarity score for the current block
+    unsigned long long mean = 0, area = 0;
+    moments block;
+    int index = 0, top = 0, half = 0;
+    Pending stack[QT_STACK], b;
+
+    stack[top++] = (Pending) {x, y, size, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+
+        // the node of the block is the next one of the pre-order
+        // (the array may be moved when a node is added, so the
+        // nodes are always accessed through their indices)
+        index = add_node(tree);
+        if(b.parent != -1)
+            set_child(&tree->node_vector[b.parent], b.child, index);
+
+        // find the colour sums of the block in constant time and
+        // assign the mean colours to current node
+        area = block_sums(table, b.x, b.y, b.size, &block);
+        mean = block_score(&tree->node_vector[index], &block, area);
+
+        // verify if the current block can be divided into quarters and 
+        // if similarity score is greater than compression factor
+        if(b.size > 1 && mean > factor)
         {
             /*
                 divide the block into quarters, which have the following 
@@ -91,377 +393,2102 @@ void build_QTree_c (QTree *tree, pixel **grid, int x, int y, int size, int facto
                 - grid[x][y + (size / 2)] for q2
                 - grid[x + (size / 2)][y + (size / 2)] for q3
                 - grid[x + (size / 2)][y] for q4
-            */
 
-            // initialize child node
-            init_QTree(&tree->q1);
-            // build sub-quadtree that corresponds to sub-block
-            build_QTree_c(tree->q1, 
-                          grid, 
-                          x, 
-                          y, 
-                          (size / 2), 
-                          factor);
+                they are pushed in reverse order, so q1 is covered first
+            */
 
-            init_QTree(&tree->q2);
-            build_QTree_c(tree->q2, 
-                          grid, 
-                          x, 
-                          y + (size / 2), 
-                          (size / 2), 
-                          factor);
+            half = b.size / 2;
+            stack[top++] = (Pending) {b.x + half, b.y, half, 0, index, 3};
+            stack[top++] = (Pending) {b.x + half, b.y + half, half, 0, 
+                                      index, 2};
+            stack[top++] = (Pending) {b.x, b.y + half, half, 0, index, 1};
+            stack[top++] = (Pending) {b.x, b.y, half, 0, index, 0};
+        }
+        else
+            set_leaf(tree, index);
+    }
+}
 
-            init_QTree(&tree->q3);
-            build_QTree_c(tree->q3, 
-                          grid, 
-                          x + (size / 2), 
-                          y + (size / 2), 
-                          (size / 2), 
-                          factor);
+/*
+function used to spread the bits of a number, so that bit k becomes bit
+2 * k (the position of a column inside the Z-order of a tile)
+*/
+static uint32_t spread_bits (uint32_t v)
+{
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
 
-            init_QTree(&tree->q4);
-            build_QTree_c(tree->q4, 
-                          grid, 
-                          x + (size / 2), 
-                          y, 
-                          (size / 2), 
-                          factor);
-        }
+    return v;
 }
 
 /*
-recursive function used build the compression quadtree based on the nodes array
+structure of sub-quadtree built by "build_post", kept until the ones of
+the other quarters of its parent block are built
+
+index = index of its root
+start = index of its first node (the number of nodes before it)
+leaves = number of leaf nodes before its first node
+sums = colour sums of its block
+*/
+typedef struct PostBlock
+{
+    int32_t index;
+    uint32_t start, leaves;
+    moments sums;
+} PostBlock;
+
+/*
+function used to build compression quadtree bottom-up, in post-order,
+adding its nodes to the end of the array
 */
-void build_QTree_d (QTree *tree, QuadtreeNode *node_vector, int index)
+static void build_post (QTree *tree, Grid *grid, int size, int factor)
 {
     /*
-        index = index of the current node in node array
+        the blocks that are being divided are kept in 'path', one for
+        each depth, and 'child' is the number of their quarters that are
+        still to be built. the quarters are built in reverse order 
+        (bottom-left, bottom-right, top-right, top-left) and added to the
+        end of the array; their colour sums, kept in 'done' until the 
+        last one is built, give the similarity score of the whole block,
+        so every pixel is read exactly once. if the block does not have 
+        to be divided, the nodes of the quarters (the last ones in the 
+        array) are removed and the block becomes a leaf node.
+
+        in the tiled layout, the pixels of a tile are stored in Z-order,
+        so a pixel is found from its line and its column in the tile
     */
 
-    // assign colour values to current node
-    tree->red = node_vector[index].red;
-    tree->green = node_vector[index].green;
-    tree->blue = node_vector[index].blue;
+    int depth = 0, count = 0, half = 0, k = 0, mask = grid->tile - 1;
+    unsigned long long mean = 0, area = 0;
+    Pending path[QT_MAX_LEVEL + 1], *b = NULL;
+    PostBlock done[QT_STACK], *quarter = NULL, result;
+    QuadtreeNode node;
+    pixel *tile = NULL, *p = NULL;
+
+    path[0] = (Pending) {0, 0, size, 0, -1, 4};
+    while(depth >= 0)
+    {
+        b = &path[depth];
+        area = block_area(b->x, b->y, b->size, grid->width, grid->height);
+        if(grid->tile > 0 && b->size == grid->tile)
+            tile = grid_tile(grid, b->x, b->y);
+
+        // build the next quarter of a block (3 = bottom-left, 
+        // 2 = bottom-right, 1 = top-right, 0 = top-left)
+        if(area > 0 && b->size > 1 && b->child > 0)
+        {
+            k = --b->child;
+            half = b->size / 2;
+            path[depth + 1] = (Pending) {b->x + ((k >= 2) ? half : 0), 
+                                         b->y + ((k == 1 || k == 2) ? half 
+                                                                    : 0),
+                                         half, 0, -1, 4};
+            depth++;
+            continue;
+        }
+
+        result.start = tree->nodes;
+        result.leaves = tree->leaves;
+        if(area == 0)
+        {
+            // a block outside the image is a leaf node with no pixels
+            result.sums.red = result.sums.green = result.sums.blue = 0;
+            result.sums.sq = 0;
+
+            result.index = add_node(tree);
+            block_score(&tree->node_vector[result.index], &result.sums, 0);
+            set_leaf(tree, result.index);
+        }
+        else if(b->size == 1)
+        {
+            // a single pixel is always a leaf node
+            if(grid->tile > 0)
+                p = tile + (spread_bits(b->x & mask) << 1) + 
+                    spread_bits(b->y & mask);
+            else
+                p = &grid_line(grid, b->x)[b->y];
+
+            result.sums.red = p->red;
+            result.sums.green = p->green;
+            result.sums.blue = p->blue;
+            result.sums.sq = p->red * p->red +
+                             p->green * p->green +
+                             p->blue * p->blue;
+
+            result.index = add_node(tree);
+            tree->node_vector[result.index].red = p->red;
+            tree->node_vector[result.index].green = p->green;
+            tree->node_vector[result.index].blue = p->blue;
+            tree->node_vector[result.index].area = 1;
+            set_leaf(tree, result.index);
+        }
+        else
+        {
+            // colour sums of the block are the sums of its quarters,
+            // the last four sub-quadtrees built (bottom-left first)
+            count = count - 4;
+            quarter = &done[count];
+            result.start = quarter[0].start;
+            result.leaves = quarter[0].leaves;
+            result.sums.red = result.sums.green = result.sums.blue = 0;
+            result.sums.sq = 0;
+            for(k = 0; k < 4; k++)
+            {
+                result.sums.red = result.sums.red + quarter[k].sums.red;
+                result.sums.green = result.sums.green + quarter[k].sums.green;
+                result.sums.blue = result.sums.blue + quarter[k].sums.blue;
+                result.sums.sq = result.sums.sq + quarter[k].sums.sq;
+            }
+
+            mean = block_score(&node, &result.sums, area);
+
+            // verify if similarity score is greater than compression factor
+            if(mean > factor)
+            {
+                // keep the quarters as child nodes
+                node.top_left = quarter[3].index;
+                node.top_right = quarter[2].index;
+                node.bottom_right = quarter[1].index;
+                node.bottom_left = quarter[0].index;
+
+                result.index = add_node(tree);
+                tree->node_vector[result.index] = node;
+            }
+            else
+            {
+                // merge the quarters into the current node
+                tree->nodes = result.start;
+                tree->leaves = result.leaves;
 
-    // verify if current array node has child nodes
-    if(node_vector[index].top_left != -1)
-    {   
+                result.index = add_node(tree);
+                tree->node_vector[result.index] = node;
+                set_leaf(tree, result.index);
+            }
+        }
 
-        // initialize sub-quadtrees corresponding to child nodes and build them
-        init_QTree(&tree->q1);
-        build_QTree_d(tree->q1, node_vector, node_vector[index].top_left);
-    
-        init_QTree(&tree->q2);
-        build_QTree_d(tree->q2, node_vector, node_vector[index].top_right);
-    
-        init_QTree(&tree->q3);
-        build_QTree_d(tree->q3, node_vector, node_vector[index].bottom_right);
-    
-        init_QTree(&tree->q4);
-        build_QTree_d(tree->q4, node_vector, node_vector[index].bottom_left);
+        // the sub-quadtree of the block is complete
+        done[count++] = result;
+        depth--;
     }
 }
 
 /*
-recursive function used to free a quadtree
+function used to build compression quadtree bottom-up, based on the pixels
+matrix of the image and the compression factor
 */
-void free_QTree (QTree **tree)
+void build_QTree_b (QTree *tree, Grid *grid, int size, int factor)
 {
-    // verify if current node is a leaf node
-    if((*tree)->q1 == NULL)
+    /*
+        the sub-quadtrees are built in post-order with the quarters
+        visited in reverse order, so reversing the array gives the 
+        pre-order layout (top-left, top-right, bottom-right, bottom-left)
+        of the top-down construction
+    */
+
+    uint32_t i = 0, last = 0;
+    QuadtreeNode aux;
+
+    build_post(tree, grid, size, factor);
+
+    // reverse the nodes array
+    last = tree->nodes - 1;
+    for(i = 0; i < tree->nodes / 2; i++)
     {
-        // free current node
-        free((*tree));
-        return;
+        aux = tree->node_vector[i];
+        tree->node_vector[i] = tree->node_vector[last - i];
+        tree->node_vector[last - i] = aux;
     }
-    
-    // free child nodes
-    free_QTree(&((*tree)->q1));
-    free_QTree(&((*tree)->q2));
-    free_QTree(&((*tree)->q3));
-    free_QTree(&((*tree)->q4));
-    
-    // free current node
-    free((*tree));
+
+    // update the indices of the child nodes
+    for(i = 0; i < tree->nodes; i++)
+        if(tree->node_vector[i].top_left != -1)
+        {
+            tree->node_vector[i].top_left = last - tree->node_vector[i].top_left;
+            tree->node_vector[i].top_right = last - 
+                                             tree->node_vector[i].top_right;
+            tree->node_vector[i].bottom_right = last - 
+                                             tree->node_vector[i].bottom_right;
+            tree->node_vector[i].bottom_left = last - 
+                                             tree->node_vector[i].bottom_left;
+        }
 }
 
 /*
-function used to build the pixels matrix of image based on its .ppm file
+structure of node of the quadtree built by the rate controlled
+construction, which keeps the order in which the blocks are divided
+
+order = number of blocks divided before this one (UINT32_MAX if it is
+        never divided)
+child = index of its first child node; the four child nodes are
+        consecutive (top-left, top-right, bottom-right, bottom-left)
 */
-void build_grid_c (pixel ***grid, int *width, int *height, int *max_color, FILE *f)
+typedef struct RateNode
 {
-    /*
-        function passes the image dimensions ('width', 'height') and the 
-        maximum value of a colour ('max_color') as parameters, after
-        reading them from input file
-    */
+    uint32_t order;
+    uint32_t child;
+} RateNode;
+
+/*
+structure of block that can be divided
 
-    int i = 0, j = 0;
-
-    // allocate 'cuv' array of type char, which stores a character read
-    // from input file in the first element (cuv[0]) and the NULL character
-    // in the second element (cuv[1])
-    char *cuv = malloc(2 * sizeof(char));
-    cuv[1] = '\0';
-    
-    // read first three characters from input file (P, 6, \n)
-    fread(cuv, sizeof(char), 1, f);
-    fread(cuv, sizeof(char), 1, f);
-    fread(cuv, sizeof(char), 1, f);
-
-    // read characters that represent the image width until 
-    // reaching ' ' character
-    fread(cuv, sizeof(char), 1, f);
-    while(cuv[0] != ' ')
-    {   
-        // convert characters to number
-        (*width) = (*width) * 10 + atoi(cuv);
-        fread(cuv, sizeof(char), 1, f); 
-    }
-
-    // read characters that represent the image height until 
-    // reaching '\n' character
-    fread(cuv, sizeof(char), 1, f);
-    while(cuv[0] != '\n')
-    {   
-        // convert characters to number
-        (*height) = (*height) * 10 + atoi(cuv);
-        fread(cuv, sizeof(char), 1, f);
-    }
-
-    // read characters that represent the value of 'max_color' until
-    // reaching '\n' character
-    fread(cuv, sizeof(char), 1, f);
-    while(cuv[0] != '\n')
-    {   
-        // convert characters to number
-        (*max_color) = (*max_color) * 10 + atoi(cuv);
-        fread(cuv, sizeof(char), 1, f);
-    }
-
-    // allocate pixels matrix
-
-    // allocate lines
-    (*grid) = (pixel **) malloc((*height) * sizeof(pixel*));
-    // allocate columns
-    for(i = 0; i < (*height); i++)
-        (*grid)[i] = (pixel *) malloc((*width) * sizeof(pixel));
-    
-    // read pixels matrix from file
-    for(i = 0; i < (*height); i++)
-        for(j = 0; j < (*width); j++)
-            fread(&(*grid)[i][j], sizeof(pixel), 1, f);
-    
-    // free 'cuv' array
-    free(cuv);
-}
-
-/*
-recursive function used to build pixels matrix based on compression quadtree
-*/
-void build_grid_d (QTree *tree, pixel **grid, int x, int y, int size)
+priority = decrease of the squared error of the image when the block is
+           divided, for each node that is added to the compressed file
+gain = decrease of the squared error
+index = index of its node
+x, y, size = block of the node
+*/
+typedef struct Candidate
 {
-    /*
-        for each call, the function builds the squared area that has the
-        top-left element located at line x, column y and size * size elements 
-    */
-    int i = 0, j = 0;
+    double priority;
+    long long gain;
+    uint32_t index;
+    int x, y, size;
+} Candidate;
 
-    // verify if current node is a leaf node
-    if(tree->q1 == NULL)
-    {
-        // assign the colour of leaf node to the area that corresponds to it
-        for(i = x; i < (x + size); i++)
-            for(j = y; j < (y + size); j++)
-            {
-                grid[i][j].red = tree->red;
-                grid[i][j].green = tree->green;
-                grid[i][j].blue = tree->blue;
-            }
-    }
-    else
-    {
-        // build sub-blocks corresponding to child nodes
-        build_grid_d(tree->q1, grid, x, y, (size / 2));
-        build_grid_d(tree->q2, grid, x, y + (size / 2), (size / 2));
-        build_grid_d(tree->q3, grid, x + (size / 2), y + (size / 2), (size / 2));
-        build_grid_d(tree->q4, grid, x + (size / 2), y, (size / 2));
-    }
+/*
+structure of the rate controlled construction
+
+node, nodes, capacity = nodes of the quadtree, in the order in which
+                        they are created
+heap, count, size = max-heap of the blocks that can be divided, by
+                    priority
+*/
+typedef struct RateTree
+{
+    RateNode *node;
+    uint32_t nodes, capacity;
+    Candidate *heap;
+    uint32_t count, size;
+} RateTree;
+
+/*
+function used to compare the priorities of two blocks; the first block 
+created is taken first if they are equal, so the order does not depend 
+on the heap
+*/
+static int rate_before (Candidate *a, Candidate *b)
+{
+    if(a->priority != b->priority)
+        return a->priority > b->priority;
+
+    return a->index < b->index;
 }
 
 /*
-recursive function used to build nodes array
-(array of quadtree nodes)
+function used to add a block to the max-heap of a rate controlled 
+construction
 */
-void build_vector (QTree *tree, QuadtreeNode *node_vector, int k, int depth, int *index_v)
+static void push_candidate (RateTree *rate, Candidate *c)
 {
-    /*
-        k = logarithm of 'width' value (or 'height' value) to base 2
-        depth = depth of current node in quadtree
-    */
-    int aux_index = 0, i = 0;
-
-    // assign colours of current node to array's corresponding element
-    node_vector[(*index_v)].blue = tree->blue;
-    node_vector[(*index_v)].green = tree->green;
-    node_vector[(*index_v)].red = tree->red;
-
-    // calculate the pixels area that the current node covers,
-    // based on its depth and the value of 'k'.
-    // we use the fact that a leaf node which has depth 'h' corresponds to 
-    // a square area of image that has a side of 2^(k-h) pixels.
-    node_vector[(*index_v)].area = 1;
-    for(i = 0; i < (k - depth); i++)
-        node_vector[(*index_v)].area = node_vector[(*index_v)].area * 2;
-    node_vector[(*index_v)].area = node_vector[(*index_v)].area * 
-                                node_vector[(*index_v)].area;
-
-    aux_index = (*index_v);
-
-    // verify if current node has child nodes
-    if(tree->q1 != NULL)
-    {
-        // add child nodes to array
-
-        // update current index
-        (*index_v)++;
-        // store index of child node
-        node_vector[aux_index].top_left = (*index_v);
-        // add corresponding sub-quadtree's nodes to the array
-        build_vector(tree->q1, node_vector, k, depth + 1, index_v);
-
-        // repeat for the other child nodes
-        (*index_v)++;
-        node_vector[aux_index].top_right = (*index_v);
-        build_vector(tree->q2, node_vector, k, depth + 1, index_v);
-
-        (*index_v)++;
-        node_vector[aux_index].bottom_right = (*index_v);
-        build_vector(tree->q3, node_vector, k, depth + 1, index_v);
-
-        (*index_v)++;
-        node_vector[aux_index].bottom_left = (*index_v);
-        build_vector(tree->q4, node_vector, k, depth + 1, index_v);
+    uint32_t i = rate->count, parent = 0;
+
+    if(rate->count == rate->size)
+    {
+        rate->size = (rate->size == 0) ? 64 : 2 * rate->size;
+        rate->heap = (Candidate *) realloc(rate->heap, 
+                                           rate->size * sizeof(Candidate));
     }
-    else
+
+    // move the block up while it comes before its parent
+    rate->count++;
+    while(i > 0)
     {
-        // current node is a leaf node
-        node_vector[aux_index].top_left = -1;
-        node_vector[aux_index].top_right = -1;
-        node_vector[aux_index].bottom_right = -1;
-        node_vector[aux_index].bottom_left = -1;
+        parent = (i - 1) / 2;
+        if(!rate_before(c, &rate->heap[parent]))
+            break;
+        rate->heap[i] = rate->heap[parent];
+        i = parent;
     }
+    rate->heap[i] = (*c);
 }
 
 /*
-recursive function used to calculate the number of 
-leaf nodes a compression quadtree has
+function used to remove the block with the highest priority from the
+max-heap of a rate controlled construction
 */
-uint32_t num_leaves (QTree *tree)
+static void pop_candidate (RateTree *rate, Candidate *top)
 {
-    // verify if current node is a leaf node
-    if(tree->q1 == NULL)
-        // count it and return
-        return 1;
-    
-    // return total number of current quadtree's leaf nodes 
-    return num_leaves(tree->q1) + 
-           num_leaves(tree->q2) + 
-           num_leaves(tree->q3) + 
-           num_leaves(tree->q4);
+    uint32_t i = 0, child = 0;
+    Candidate last;
+
+    (*top) = rate->heap[0];
+    last = rate->heap[--rate->count];
+
+    // move the last block down from the root
+    while((child = 2 * i + 1) < rate->count)
+    {
+        if(child + 1 < rate->count && 
+           rate_before(&rate->heap[child + 1], &rate->heap[child]))
+            child++;
+        if(!rate_before(&rate->heap[child], &last))
+            break;
+        rate->heap[i] = rate->heap[child];
+        i = child;
+    }
+    rate->heap[i] = last;
 }
 
 /*
-recursive function used to calculate the number of
-nodes a compression quadtree has
+function used to find the squared error of a block and its similarity 
+score
 */
-uint32_t num_nodes (QTree *tree)
+static long long rate_error (SumTable *table, int x, int y, int size, unsigned long long *score)
 {
-    // verify if current node is a leaf node
-    if(tree->q1 == NULL)
-        // count it and return
-        return 1;
-    
-    // return 1 + number of nodes the sub-quadtrees have
-    return 1 +
-           num_nodes(tree->q1) + 
-           num_nodes(tree->q2) + 
-           num_nodes(tree->q3) + 
-           num_nodes(tree->q4);
+    moments block;
+    QuadtreeNode node;
+    unsigned long long area = block_sums(table, x, y, size, &block);
+    unsigned long long error = block_error(&node, &block, area);
+
+    (*score) = (area > 0) ? error / (3 * area) : 0;
+
+    return error;
 }
 
 /*
-recursive function used to flip the image vertically,
-by modifying it's quadtree
+function used to add the block of a node to the max-heap, if it can be 
+divided: it is larger than a pixel and its similarity score is greater
+than the compression factor, like for the other constructions
 */
-void flip_vertical (QTree *tree)
+static void add_candidate (RateTree *rate, SumTable *table, uint32_t index, int x, int y, int size, int factor, int compact)
 {
-    QTree *aux = NULL;
+    int half = size / 2, k = 0, cost = 0;
+    int cx[4] = {x, x, x + half, x + half};
+    int cy[4] = {y, y + half, y + half, y};
+    unsigned long long score = 0, child_score = 0;
+    Candidate c;
 
-    // verify if current node is a leaf node
-    if(tree->q1 == NULL)
-        // nothing to be done, return
+    if(size == 1)
         return;
 
-    // interchange top-left and bottom-left
-    aux = tree->q1;
-    tree->q1 = tree->q4;
-    tree->q4 = aux;
+    c.gain = rate_error(table, x, y, size, &score);
+    if(score <= factor)
+        return;
 
-    // interchange top-right and bottom-right
-    aux = tree->q2;
-    tree->q2 = tree->q3;
-    tree->q3 = aux;
+    // the legacy format stores all four child nodes, the compact one
+    // only the ones with pixels of the image
+    for(k = 0; k < 4; k++)
+    {
+        c.gain = c.gain - rate_error(table, cx[k], cy[k], half, &child_score);
+        if(!compact || block_area(cx[k], cy[k], half, table->width, 
+                                  table->height) > 0)
+            cost++;
+    }
 
-    // repeat steps for current node's children
-    flip_vertical(tree->q1);
-    flip_vertical(tree->q2);
-    flip_vertical(tree->q3);
-    flip_vertical(tree->q4);
+    c.priority = (double) c.gain / cost;
+    c.index = index;
+    c.x = x;
+    c.y = y;
+    c.size = size;
+    push_candidate(rate, &c);
 }
 
 /*
-recursive function used to flip the image horizontally,
-by modifying it's quadtree
+function used to build the compression quadtree, in pre-order, from the
+first 'count' blocks divided by a rate controlled construction
 */
-void flip_horizontal (QTree *tree)
+static void build_rate (QTree *tree, SumTable *table, RateTree *rate, int size, uint32_t count)
 {
-    QTree *aux = NULL;
+    // 'index' stores the node of the block in the rate controlled
+    // construction
+    moments block;
+    unsigned long long area = 0;
+    int index = 0, top = 0, half = 0;
+    uint32_t child = 0;
+    Pending stack[QT_STACK], b;
 
-    // verify if current node is a leaf node
-    if(tree->q1 == NULL)
-        // nothing to be done, return
-        return;
+    stack[top++] = (Pending) {0, 0, size, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        index = add_node(tree);
+        if(b.parent != -1)
+            set_child(&tree->node_vector[b.parent], b.child, index);
+
+        area = block_sums(table, b.x, b.y, b.size, &block);
+        block_score(&tree->node_vector[index], &block, area);
 
-    // interchange top-left and top-right
-    aux = tree->q1;
-    tree->q1 = tree->q2;
-    tree->q2 = aux;
+        if(rate->node[b.index].order >= count)
+        {
+            set_leaf(tree, index);
+            continue;
+        }
+
+        half = b.size / 2;
+        child = rate->node[b.index].child;
+        stack[top++] = (Pending) {b.x + half, b.y, half, child + 3, index, 3};
+        stack[top++] = (Pending) {b.x + half, b.y + half, half, child + 2, 
+                                  index, 2};
+        stack[top++] = (Pending) {b.x, b.y + half, half, child + 1, index, 1};
+        stack[top++] = (Pending) {b.x, b.y, half, child, index, 0};
+    }
+}
 
-    // interchange bottom-left and bottom-right
-    aux = tree->q3;
-    tree->q3 = tree->q4;
-    tree->q4 = aux;
+/*
+function used to find the size of the compressed file of the quadtree
+obtained from the first 'count' blocks divided; the quadtree is built
+in 'tree'
+*/
+static size_t rate_size (QTree *tree, SumTable *table, RateTree *rate, int size, uint32_t count, int compact)
+{
+    tree->nodes = 0;
+    tree->leaves = 0;
+    build_rate(tree, table, rate, size, count);
 
-    // repeat steps for current node's children
-    flip_horizontal(tree->q1);
-    flip_horizontal(tree->q2);
-    flip_horizontal(tree->q3);
-    flip_horizontal(tree->q4);
+    return compressed_size(tree, table->width, table->height, compact);
 }
 
 /*
-function used to calculate the value of logarithm of x to base 2
+function used to build compression quadtree for a target size of the
+compressed file and/or a target PSNR, based on the summed-area table
+of the image; the blocks with a similarity score that is not greater 
+than the compression factor are never divided
 */
-int log_two (int x)
+void build_QTree_rate (QTree *tree, SumTable *table, int size, int factor, Budget *budget)
 {
-    int exp = 0;
+    /*
+        starting from the root, the block that decreases the squared
+        error of the image the most for each node added to the file is
+        always divided next, until the PSNR of the image reaches the
+        target or no block can be divided. the order of the divisions
+        is kept in a separate tree, so the quadtree obtained after any
+        number of them can be built in pre-order.
+        for a target size, the size of the file is found (by writing it
+        in memory) every time the number of divisions doubles; once it 
+        is too large, a binary search between the last two checks finds
+        the largest number of divisions that fits.
+    */
+
+    int k = 0, half = 0;
+    uint32_t divisions = 0, check = 64, fits = 0, over = 0, mid = 0;
+    unsigned long long pixels = (unsigned long long) table->width * 
+                                table->height, score = 0;
+    long long error = rate_error(table, 0, 0, size, &score);
+    double limit = -1;
+    Candidate top;
+    RateTree rate = {NULL, 0, 0, NULL, 0, 0};
+
+    // largest squared error of the image for the target PSNR, with 
+    // colour values of at most 255
+    if(budget->psnr > 0)
+        limit = 3.0 * pixels * 255 * 255 / pow(10, budget->psnr / 10);
+
+    rate.capacity = 64;
+    rate.node = (RateNode *) malloc(rate.capacity * sizeof(RateNode));
+    rate.node[0].order = UINT32_MAX;
+    rate.nodes = 1;
+    add_candidate(&rate, table, 0, 0, 0, size, factor, budget->compact);
+
+    while(rate.count > 0 && !(limit >= 0 && error <= limit))
+    {
+        pop_candidate(&rate, &top);
+
+        // divide the block, adding its child nodes
+        if(rate.nodes + 4 > rate.capacity)
+        {
+            rate.capacity = 2 * rate.capacity;
+            rate.node = (RateNode *) realloc(rate.node, 
+                                         rate.capacity * sizeof(RateNode));
+        }
+        rate.node[top.index].order = divisions++;
+        rate.node[top.index].child = rate.nodes;
+        error = error - top.gain;
+
+        half = top.size / 2;
+        for(k = 0; k < 4; k++)
+        {
+            int x = top.x + ((k == 2 || k == 3) ? half : 0);
+            int y = top.y + ((k == 1 || k == 2) ? half : 0);
+
+            rate.node[rate.nodes].order = UINT32_MAX;
+            add_candidate(&rate, table, rate.nodes, x, y, half, factor, 
+                          budget->compact);
+            rate.nodes++;
+        }
+
+        // check the size of the file
+        if(budget->bytes > 0 && divisions == check)
+        {
+            if(rate_size(tree, table, &rate, size, divisions, 
+                         budget->compact) > budget->bytes)
+            {
+                over = divisions;
+                break;
+            }
+            fits = divisions;
+            check = 2 * check;
+        }
+    }
 
-    while(x != 1)
+    if(budget->bytes > 0 && over == 0 && divisions > fits)
     {
-        exp++;
-        x = x / 2;
+        if(rate_size(tree, table, &rate, size, divisions, 
+                     budget->compact) > budget->bytes)
+            over = divisions;
+        else
+            fits = divisions;
+    }
+
+    // find the largest number of divisions that fits
+    if(over != 0)
+    {
+        while(over - fits > 1)
+        {
+            mid = fits + (over - fits) / 2;
+            if(rate_size(tree, table, &rate, size, mid, 
+                         budget->compact) > budget->bytes)
+                over = mid;
+            else
+                fits = mid;
+        }
+        divisions = fits;
     }
 
-    return exp;
-}
\ No newline at end of file
+    tree->nodes = 0;
+    tree->leaves = 0;
+    build_rate(tree, table, &rate, size, divisions);
+
+    free(rate.node);
+    free(rate.heap);
+}
+
+/*
+function used to build the pixels matrix of image based on its .ppm file;
+returns 0 on success and -1 if the file is not a valid .ppm image
+*/
+int build_grid_c (Grid *grid, FILE *f)
+{
+    /*
+        the file is memory mapped and the pixels matrix points directly
+        to the pixels stored after the header, so they are never copied.
+        if that is not possible (for example, for a pipe), the pixels are
+        read with a single call.
+        the image dimensions ('width', 'height') and the maximum value of 
+        a colour ('max_color') are read from the header.
+        the files of the other types ("P3", "P5", or samples larger than
+        255) are converted to the pixels matrix as they are read.
+    */
+
+    struct stat info;
+    long offset = 0;
+    size_t size = 0;
+
+    grid->data = NULL;
+    grid->mapped = 0;
+    grid->tile = 0;
+
+    if(read_header(grid, f) != 0)
+        return -1;
+
+    grid->stride = grid->width;
+    size = (size_t) grid->width * grid->height * sizeof(pixel);
+    offset = ftell(f);
+
+    // map regular files in memory; the mapping is private, so the
+    // pixels matrix can be modified without changing the file
+    if(raw_pixels(grid) && offset > 0 && fstat(fileno(f), &info) == 0 && 
+       S_ISREG(info.st_mode) && (size_t) info.st_size >= offset + size)
+    {
+        void *map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE, fileno(f), 0);
+        if(map != MAP_FAILED)
+        {
+            grid->data = (unsigned char *) map;
+            grid->data_size = info.st_size;
+            grid->mapped = 1;
+            grid->pixels = (pixel *) (grid->data + offset);
+            return 0;
+        }
+    }
+
+    // read pixels matrix with a single call
+    grid->pixels = (pixel *) malloc(size);
+    if(read_pixels(grid, f, grid->pixels, 
+                   (size_t) grid->width * grid->height) != 0)
+    {
+        free_grid(grid);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+function used to build the pixels matrix of an image based on its .ppm 
+file, in the tiled layout with tiles of tile * tile pixels (a power of 
+two); returns 0 on success and -1 if the file is not a valid .ppm image
+*/
+int build_grid_t (Grid *grid, FILE *f, int tile)
+{
+    /*
+        the lines are read in bands of 'tile' lines, the height of a line
+        of tiles, and every pixel is moved to its place in its tile as
+        soon as its band is read, so the image is never stored line by 
+        line
+    */
+
+    int i = 0, j = 0, k = 0, t = 0, lines = 0, width = 0;
+    int across = 0, down = 0;
+    uint32_t *column = NULL;
+    size_t count = 0;
+    pixel *band = NULL, *p = NULL, *q = NULL;
+
+    grid->data = NULL;
+    grid->mapped = 0;
+
+    if(read_header(grid, f) != 0)
+        return -1;
+
+    // the tiles are not larger than the square of the quadtree
+    if(tile > quadtree_size(grid->width, grid->height))
+        tile = quadtree_size(grid->width, grid->height);
+
+    across = (grid->width + tile - 1) / tile;
+    down = (grid->height + tile - 1) / tile;
+    grid->tile = tile;
+    grid->stride = across;
+    grid->pixels = (pixel *) malloc((size_t) across * down * tile * tile * 
+                                    sizeof(pixel));
+
+    // column[j] = position of column j of a tile in its Z-order
+    column = (uint32_t *) malloc(tile * sizeof(uint32_t));
+    for(j = 0; j < tile; j++)
+        column[j] = spread_bits(j);
+
+    band = (pixel *) malloc((size_t) tile * grid->width * sizeof(pixel));
+    for(k = 0; k < down; k++)
+    {
+        lines = (grid->height - k * tile < tile) ? grid->height - k * tile
+                                                  : tile;
+        count = (size_t) lines * grid->width;
+        if(read_pixels(grid, f, band, count) != 0)
+        {
+            free(band);
+            free(column);
+            free_grid(grid);
+            return -1;
+        }
+
+        // line i of the band goes to the positions of line i of
+        // the tiles, which are interleaved with their columns
+        for(i = 0; i < lines; i++)
+        {
+            p = band + (size_t) i * grid->width;
+            q = grid_tile(grid, k * tile, 0) + (spread_bits(i) << 1);
+            for(t = 0; t < across; t++)
+            {
+                width = (grid->width - t * tile < tile) ? 
+                        grid->width - t * tile : tile;
+                for(j = 0; j < width; j++)
+                    q[column[j]] = p[j];
+
+                p = p + tile;
+                q = q + (size_t) tile * tile;
+            }
+        }
+    }
+
+    free(band);
+    free(column);
+
+    return 0;
+}
+
+/*
+function used to allocate a pixels matrix of given dimensions
+*/
+void alloc_grid (Grid *grid, int width, int height)
+{
+    grid->width = width;
+    grid->height = height;
+    grid->stride = width;
+    grid->format = PPM_RGB;
+    grid->max_color = 255;
+    grid->data = NULL;
+    grid->data_size = 0;
+    grid->mapped = 0;
+    grid->tile = 0;
+    grid->pixels = (pixel *) malloc((size_t) width * height * sizeof(pixel));
+}
+
+/*
+function used to free a pixels matrix
+*/
+void free_grid (Grid *grid)
+{
+    if(grid->mapped)
+        munmap(grid->data, grid->data_size);
+    else
+        free(grid->pixels);
+
+    grid->data = NULL;
+    grid->pixels = NULL;
+    grid->mapped = 0;
+}
+
+/*
+function used to render the lines first..last - 1 of the block covered by
+a node in a buffer of lines, in which line 'first' is the first one; only
+the columns of the view are rendered
+*/
+static void render_block (QTree *tree, int index, int x, int y, int size, int first, int last, pixel *lines, View *view)
+{
+    /*
+        x, y, size = block of the node, in the coordinates of the image 
+        reduced by the view; a node that covers a single pixel of the
+        reduced image is rendered with its mean colours, even if it has 
+        child nodes
+    */
+
+    int i = 0, j = 0, top = 0, bottom = 0, left = 0, right = 0, count = 0;
+    int half = 0;
+    QuadtreeNode *node = NULL;
+    pixel *p = NULL;
+    Pending stack[QT_STACK], b;
+
+    stack[count++] = (Pending) {x, y, size, index, -1, 0};
+    while(count > 0)
+    {
+        b = stack[--count];
+        top = (b.x > first) ? b.x : first;
+        bottom = (b.x + b.size < last) ? b.x + b.size : last;
+        left = (b.y > view->column) ? b.y : view->column;
+        right = (b.y + b.size < view->column + view->width) ? 
+                b.y + b.size : view->column + view->width;
+
+        // verify if the block has pixels inside the buffer
+        if(top >= bottom || left >= right)
+            continue;
+
+        // verify if current node is a leaf node
+        node = &tree->node_vector[b.index];
+        if(node->top_left == -1 || b.size == 1)
+        {
+            // assign the colour of the node to the part of its
+            // block that is inside the buffer
+            for(i = top; i < bottom; i++)
+            {
+                p = lines + (size_t) (i - first) * view->width - 
+                    view->column;
+                for(j = left; j < right; j++)
+                {
+                    p[j].red = node->red;
+                    p[j].green = node->green;
+                    p[j].blue = node->blue;
+                }
+            }
+            continue;
+        }
+
+        // only the quarters that contain pixels of the buffer are 
+        // rendered
+        half = b.size / 2;
+        stack[count++] = (Pending) {b.x + half, b.y, half, 
+                                    node->bottom_left, -1, 0};
+        stack[count++] = (Pending) {b.x + half, b.y + half, half, 
+                                    node->bottom_right, -1, 0};
+        stack[count++] = (Pending) {b.x, b.y + half, half, 
+                                    node->top_right, -1, 0};
+        stack[count++] = (Pending) {b.x, b.y, half, node->top_left, -1, 0};
+    }
+}
+
+/*
+function used to set a view that covers the whole image with given
+dimensions described by a quadtree, reduced 2^shift times (at most until
+its quadtree covers a single pixel); a pixel of the reduced image that 
+is only partly inside the image has the mean colours of that part
+*/
+void init_view (View *view, QTree *tree, int width, int height, int shift)
+{
+    int size = quadtree_size(width, height);
+
+    while(shift > 0 && (size >> shift) == 0)
+        shift--;
+
+    // the reduced image starts at the reduced pixel that has the
+    // top-left pixel of the image
+    view->size = size;
+    view->shift = shift;
+    view->line = tree->line >> shift;
+    view->column = tree->column >> shift;
+    view->lines = ((tree->line + height - 1) >> shift) - view->line + 1;
+    view->columns = ((tree->column + width - 1) >> shift) - view->column + 1;
+    view->width = view->columns;
+    view->height = view->lines;
+}
+
+/*
+function used to render 'count' lines of a view, starting with line
+'first' of the reduced image, directly from the compression quadtree; 
+'lines' stores count * view->width pixels
+*/
+void render_lines (QTree *tree, View *view, int first, int count, pixel *lines)
+{
+    render_block(tree, 0, 0, 0, view->size >> view->shift, first, 
+                 first + count, lines, view);
+}
+
+/*
+function used to flip the image vertically, by modifying it's quadtree;
+the child indices of every node are interchanged, so no node is moved
+*/
+void flip_vertical (QTree *tree)
+{
+    uint32_t i = 0;
+    int32_t aux = 0;
+    QuadtreeNode *node = NULL;
+
+    for(i = 0; i < tree->nodes; i++)
+    {
+        node = &tree->node_vector[i];
+
+        // interchange top-left and bottom-left
+        aux = node->top_left;
+        node->top_left = node->bottom_left;
+        node->bottom_left = aux;
+
+        // interchange top-right and bottom-right
+        aux = node->top_right;
+        node->top_right = node->bottom_right;
+        node->bottom_right = aux;
+    }
+}
+
+/*
+function used to flip the image horizontally, by modifying it's quadtree;
+the child indices of every node are interchanged, so no node is moved
+*/
+void flip_horizontal (QTree *tree)
+{
+    uint32_t i = 0;
+    int32_t aux = 0;
+    QuadtreeNode *node = NULL;
+
+    for(i = 0; i < tree->nodes; i++)
+    {
+        node = &tree->node_vector[i];
+
+        // interchange top-left and top-right
+        aux = node->top_left;
+        node->top_left = node->top_right;
+        node->top_right = aux;
+
+        // interchange bottom-left and bottom-right
+        aux = node->bottom_right;
+        node->bottom_right = node->bottom_left;
+        node->bottom_left = aux;
+    }
+}
+
+/*
+function used to transform the image described by a quadtree (flip it,
+rotate it clockwise or transpose it) by permuting the child indices of
+every node, so no node is moved
+*/
+void transform_QTree (QTree *tree, int type)
+{
+    /*
+        order[type][k] = the child that becomes child k, with the children
+        numbered in pre-order (0 = top-left, 1 = top-right, 2 = 
+        bottom-right, 3 = bottom-left)
+    */
+
+    static const int order[TRANSFORMS][4] =
+    {
+        {3, 2, 1, 0},   // vertical flip
+        {1, 0, 3, 2},   // horizontal flip
+        {0, 3, 2, 1},   // transpose
+        {3, 0, 1, 2},   // rotation by 90 degrees
+        {2, 3, 0, 1},   // rotation by 180 degrees
+        {1, 2, 3, 0}    // rotation by 270 degrees
+    };
+    uint32_t i = 0;
+    int32_t child[4];
+    QuadtreeNode *node = NULL;
+
+    for(i = 0; i < tree->nodes; i++)
+    {
+        node = &tree->node_vector[i];
+        if(node->top_left == -1)
+            continue;
+
+        child[0] = node->top_left;
+        child[1] = node->top_right;
+        child[2] = node->bottom_right;
+        child[3] = node->bottom_left;
+
+        node->top_left = child[order[type][0]];
+        node->top_right = child[order[type][1]];
+        node->bottom_right = child[order[type][2]];
+        node->bottom_left = child[order[type][3]];
+    }
+}
+
+/*
+function used to copy the sub-quadtree of a node at the end of the nodes
+array of another quadtree, in pre-order
+*/
+static void copy_preorder (QTree *tree, int index, QTree *copy)
+{
+    int position = 0, top = 0;
+    QuadtreeNode *node = NULL;
+    Pending stack[QT_STACK], b;
+
+    stack[top++] = (Pending) {0, 0, 0, index, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        node = &tree->node_vector[b.index];
+        position = add_node(copy);
+        copy->node_vector[position] = (*node);
+        if(b.parent != -1)
+            set_child(&copy->node_vector[b.parent], b.child, position);
+
+        if(node->top_left == -1)
+        {
+            set_leaf(copy, position);
+            continue;
+        }
+
+        // the children are pushed in reverse order, so they are
+        // copied in pre-order
+        stack[top++] = (Pending) {0, 0, 0, node->bottom_left, position, 3};
+        stack[top++] = (Pending) {0, 0, 0, node->bottom_right, position, 2};
+        stack[top++] = (Pending) {0, 0, 0, node->top_right, position, 1};
+        stack[top++] = (Pending) {0, 0, 0, node->top_left, position, 0};
+    }
+}
+
+/*
+function used to move the nodes of a quadtree back to the pre-order
+layout (after its child indices were permuted), so it can be written in 
+the same compressed file as a quadtree built from an image
+*/
+void order_QTree (QTree *tree)
+{
+    QTree copy;
+
+    init_QTree(&copy);
+    reserve_QTree(&copy, tree->nodes);
+    copy_preorder(tree, 0, &copy);
+    copy.line = tree->line;
+    copy.column = tree->column;
+
+    free_QTree(tree);
+    (*tree) = copy;
+}
+
+/*
+function used to transform the image described by a quadtree and find
+its new dimensions; the nodes stay in the pre-order layout and no pixel
+is rendered: an image that does not fill the square of its quadtree is
+only moved inside the square, which is recorded in the quadtree
+*/
+void transform_image (QTree *tree, int type, int *width, int *height)
+{
+    int size = quadtree_size(*width, *height);
+    int line = tree->line, column = tree->column, aux = 0;
+
+    transform_QTree(tree, type);
+    order_QTree(tree);
+
+    // find where the rectangle of the image is moved inside the square;
+    // the transpose and the rotations by 90 and 270 degrees interchange
+    // its width and height
+    if(type == TRANSFORM_V || type == TRANSFORM_180)
+        tree->line = size - line - (*height);
+    if(type == TRANSFORM_H || type == TRANSFORM_180)
+        tree->column = size - column - (*width);
+    if(type == TRANSFORM_T)
+    {
+        tree->line = column;
+        tree->column = line;
+    }
+    if(type == TRANSFORM_90)
+    {
+        tree->line = column;
+        tree->column = size - line - (*height);
+    }
+    if(type == TRANSFORM_270)
+    {
+        tree->line = size - column - (*width);
+        tree->column = line;
+    }
+    if(type == TRANSFORM_T || type == TRANSFORM_90 || type == TRANSFORM_270)
+    {
+        aux = (*width);
+        (*width) = (*height);
+        (*height) = aux;
+    }
+}
+
+/*
+structure of sub-quadtree built or processed by a single task
+
+x, y = line and column of the top-left element of the block it covers
+size = side length of the block
+index = index of its root in the nodes array of the whole quadtree
+tree = nodes of the sub-quadtree while it is built, with indices
+       relative to its own array
+*/
+typedef struct Subtree
+{
+    int x, y, size;
+    uint32_t index;
+    QTree tree;
+} Subtree;
+
+/*
+structure of partition of a quadtree into independent sub-quadtrees
+*/
+typedef struct Partition
+{
+    Subtree *part;
+    int count, capacity;
+} Partition;
+
+/*
+structure of the argument of a task that processes a sub-quadtree
+
+view, image = view that is rendered and its pixels (only for the tasks
+              that render a view)
+*/
+typedef struct PartJob
+{
+    Subtree *part;
+    QTree *tree;
+    SumTable *table;
+    int factor;
+    View *view;
+    pixel *image;
+} PartJob;
+
+/*
+function used to add a sub-quadtree to a partition and return its number
+*/
+static int add_part (Partition *p, int x, int y, int size, uint32_t index)
+{
+    if(p->count == p->capacity)
+    {
+        p->capacity = (p->capacity == 0) ? 16 : 2 * p->capacity;
+        p->part = (Subtree *) realloc(p->part, p->capacity * sizeof(Subtree));
+    }
+
+    p->part[p->count].x = x;
+    p->part[p->count].y = y;
+    p->part[p->count].size = size;
+    p->part[p->count].index = index;
+    init_QTree(&p->part[p->count].tree);
+    p->count++;
+
+    return p->count - 1;
+}
+
+/*
+function used to run a task for every sub-quadtree of a partition and 
+wait for all of them
+*/
+static void run_parts (Partition *p, task_fn fn, PartJob *job, ThreadPool *pool)
+{
+    int i = 0;
+    PartJob *jobs = (PartJob *) malloc(p->count * sizeof(PartJob));
+
+    for(i = 0; i < p->count; i++)
+    {
+        jobs[i] = (*job);
+        jobs[i].part = &p->part[i];
+        pool_submit(pool, fn, &jobs[i]);
+    }
+
+    pool_wait(pool);
+    free(jobs);
+}
+
+/*
+function used to build the nodes of the compression quadtree that cover
+blocks larger than the threshold, in pre-order; the place of each smaller
+block is kept by a node whose 'top_left' field stores -2 - (number of its
+sub-quadtree)
+*/
+static void build_top (QTree *top, SumTable *table, int size, int factor, int threshold, Partition *p)
+{
+    unsigned long long mean = 0, area = 0;
+    moments block;
+    int index = 0, count = 0, half = 0;
+    Pending stack[QT_STACK], b;
+
+    stack[count++] = (Pending) {0, 0, size, 0, -1, 0};
+    while(count > 0)
+    {
+        b = stack[--count];
+        index = add_node(top);
+        if(b.parent != -1)
+            set_child(&top->node_vector[b.parent], b.child, index);
+
+        if(b.size <= threshold)
+        {
+            top->node_vector[index].top_left = -2 - add_part(p, b.x, b.y, 
+                                                             b.size, 0);
+            continue;
+        }
+
+        area = block_sums(table, b.x, b.y, b.size, &block);
+        mean = block_score(&top->node_vector[index], &block, area);
+
+        if(mean > factor)
+        {
+            half = b.size / 2;
+            stack[count++] = (Pending) {b.x + half, b.y, half, 0, index, 3};
+            stack[count++] = (Pending) {b.x + half, b.y + half, half, 0, 
+                                        index, 2};
+            stack[count++] = (Pending) {b.x, b.y + half, half, 0, index, 1};
+            stack[count++] = (Pending) {b.x, b.y, half, 0, index, 0};
+        }
+        else
+            set_leaf(top, index);
+    }
+}
+
+/*
+task used to build a sub-quadtree in its own nodes array
+*/
+static void build_task (void *arg)
+{
+    PartJob *job = (PartJob *) arg;
+    Subtree *part = job->part;
+
+    build_QTree_c(&part->tree, job->table, part->x, part->y, part->size,
+                  job->factor);
+}
+
+/*
+task used to copy the nodes of a sub-quadtree to the nodes array of the
+whole quadtree, starting at the index of its root
+*/
+static void stitch_task (void *arg)
+{
+    PartJob *job = (PartJob *) arg;
+    Subtree *part = job->part;
+    QuadtreeNode *node = NULL;
+    uint32_t i = 0;
+
+    for(i = 0; i < part->tree.nodes; i++)
+    {
+        node = &job->tree->node_vector[part->index + i];
+        (*node) = part->tree.node_vector[i];
+
+        if(node->top_left != -1)
+        {
+            node->top_left = node->top_left + part->index;
+            node->top_right = node->top_right + part->index;
+            node->bottom_right = node->bottom_right + part->index;
+            node->bottom_left = node->bottom_left + part->index;
+        }
+    }
+
+    free_QTree(&part->tree);
+}
+
+/*
+function used to build compression quadtree on multiple threads; the blocks
+with a side length of at most 'threshold' pixels are built by separate tasks
+in their own nodes arrays, which are then stitched in pre-order
+*/
+void build_QTree_c_parallel (QTree *tree, SumTable *table, int size, int factor, int threshold, ThreadPool *pool)
+{
+    int part = 0;
+    uint32_t i = 0, cursor = 0;
+    uint32_t *position = NULL;
+    QuadtreeNode *node = NULL;
+    QTree top;
+    Partition p = {NULL, 0, 0};
+    PartJob job = {NULL, tree, table, factor, NULL, NULL};
+
+    if(size <= threshold)
+    {
+        build_QTree_c(tree, table, 0, 0, size, factor);
+        return;
+    }
+
+    // build the nodes above the threshold and the sub-quadtrees
+    init_QTree(&top);
+    build_top(&top, table, size, factor, threshold, &p);
+    run_parts(&p, build_task, &job, pool);
+
+    // find the index of every node of 'top' in the whole quadtree; 
+    // each sub-quadtree takes the place of the node that marks it
+    position = (uint32_t *) malloc(top.nodes * sizeof(uint32_t));
+    tree->leaves = top.leaves;
+    for(i = 0; i < top.nodes; i++)
+    {
+        position[i] = cursor;
+        if(top.node_vector[i].top_left < -1)
+        {
+            part = -2 - top.node_vector[i].top_left;
+            p.part[part].index = cursor;
+            cursor = cursor + p.part[part].tree.nodes;
+            tree->leaves = tree->leaves + p.part[part].tree.leaves;
+        }
+        else
+            cursor++;
+    }
+
+    reserve_QTree(tree, cursor);
+    tree->nodes = cursor;
+
+    // copy the nodes of 'top' with their new child indices
+    for(i = 0; i < top.nodes; i++)
+    {
+        if(top.node_vector[i].top_left < -1)
+            continue;
+
+        node = &tree->node_vector[position[i]];
+        (*node) = top.node_vector[i];
+
+        if(node->top_left != -1)
+        {
+            node->top_left = position[node->top_left];
+            node->top_right = position[node->top_right];
+            node->bottom_right = position[node->bottom_right];
+            node->bottom_left = position[node->bottom_left];
+        }
+    }
+
+    // copy the sub-quadtrees
+    run_parts(&p, stitch_task, &job, pool);
+
+    free(position);
+    free_QTree(&top);
+    free(p.part);
+}
+
+/*
+structure of the argument of a task that renders a band of lines
+*/
+typedef struct LineJob
+{
+    QTree *tree;
+    View *view;
+    int first, count;
+    pixel *lines;
+} LineJob;
+
+/*
+task used to render a band of lines of the image
+*/
+static void render_task (void *arg)
+{
+    LineJob *job = (LineJob *) arg;
+
+    render_lines(job->tree, job->view, job->first, job->count, job->lines);
+}
+
+/*
+function used to render 'count' lines of a view, starting with line
+'first', on multiple threads; every band of 'band' lines is rendered by
+a separate task
+*/
+void render_lines_parallel (QTree *tree, View *view, int first, int count, pixel *lines, int band, ThreadPool *pool)
+{
+    int i = 0, tasks = (count + band - 1) / band;
+    LineJob *jobs = (LineJob *) malloc(tasks * sizeof(LineJob));
+
+    for(i = 0; i < tasks; i++)
+    {
+        jobs[i].tree = tree;
+        jobs[i].view = view;
+        jobs[i].first = first + i * band;
+        jobs[i].count = (count - i * band < band) ? count - i * band : band;
+        jobs[i].lines = lines + (size_t) i * band * view->width;
+        pool_submit(pool, render_task, &jobs[i]);
+    }
+
+    pool_wait(pool);
+    free(jobs);
+}
+
+/*
+function used to divide the square of a view into the blocks of at most
+'threshold' pixels that have pixels inside the view, each with the node
+that covers it; a leaf node larger than the threshold is divided too, so
+its block is shared between several tasks
+*/
+static void split_view (QTree *tree, View *view, int threshold, Partition *p)
+{
+    int count = 0, half = 0;
+    QuadtreeNode *node = NULL;
+    Pending stack[QT_STACK], b;
+
+    stack[count++] = (Pending) {0, 0, view->size >> view->shift, 0, -1, 0};
+    while(count > 0)
+    {
+        b = stack[--count];
+
+        // verify if the block has pixels inside the view
+        if(b.x >= view->line + view->height || b.x + b.size <= view->line ||
+           b.y >= view->column + view->width || 
+           b.y + b.size <= view->column)
+            continue;
+
+        if(b.size <= threshold)
+        {
+            add_part(p, b.x, b.y, b.size, b.index);
+            continue;
+        }
+
+        // the quarters of a leaf node keep the index of the node
+        node = &tree->node_vector[b.index];
+        half = b.size / 2;
+        if(node->top_left == -1)
+        {
+            stack[count++] = (Pending) {b.x + half, b.y, half, b.index, -1, 0};
+            stack[count++] = (Pending) {b.x + half, b.y + half, half, 
+                                        b.index, -1, 0};
+            stack[count++] = (Pending) {b.x, b.y + half, half, b.index, -1, 0};
+            stack[count++] = (Pending) {b.x, b.y, half, b.index, -1, 0};
+            continue;
+        }
+
+        stack[count++] = (Pending) {b.x + half, b.y, half, 
+                                    node->bottom_left, -1, 0};
+        stack[count++] = (Pending) {b.x + half, b.y + half, half, 
+                                    node->bottom_right, -1, 0};
+        stack[count++] = (Pending) {b.x, b.y + half, half, 
+                                    node->top_right, -1, 0};
+        stack[count++] = (Pending) {b.x, b.y, half, node->top_left, -1, 0};
+    }
+}
+
+/*
+task used to render the block of a sub-quadtree in its own rectangle of
+the pixels of a view
+*/
+static void view_task (void *arg)
+{
+    PartJob *job = (PartJob *) arg;
+    Subtree *part = job->part;
+    View *view = job->view;
+    int first = (part->x > view->line) ? part->x : view->line;
+    int last = (part->x + part->size < view->line + view->height) ? 
+               part->x + part->size : view->line + view->height;
+
+    render_block(job->tree, part->index, part->x, part->y, part->size, 
+                 first, last, job->image + (size_t) (first - view->line) * 
+                 view->width, view);
+}
+
+/*
+function used to render a whole view on multiple threads, in a buffer of
+view->width * view->height pixels; the sub-quadtrees of the blocks of at
+most 'threshold' pixels are rendered by separate tasks, directly in the
+disjoint rectangles of the buffer covered by their blocks
+*/
+void render_view_parallel (QTree *tree, View *view, pixel *image, int threshold, ThreadPool *pool)
+{
+    Partition p = {NULL, 0, 0};
+    PartJob job = {NULL, tree, NULL, 0, view, image};
+
+    split_view(tree, view, threshold, &p);
+    run_parts(&p, view_task, &job, pool);
+
+    free(p.part);
+}
+
+/*
+structure of block of the image compressed in streaming mode
+
+sums = colour sums of the block
+area = number of pixels of the image inside the block
+nodes, leaves = number of nodes and leaf nodes of its sub-quadtree
+offset = position of its nodes in the temporary file (only for the blocks
+         built from the pixels)
+
+the image is divided into at most STREAM_BLOCKS * STREAM_BLOCKS blocks, so
+the pyramid of blocks has a bounded size whatever the number of lines of
+the bands
+*/
+#define STREAM_BLOCKS 256
+
+typedef struct StreamBlock
+{
+    moments sums;
+    uint32_t area;
+    uint32_t nodes, leaves;
+    off_t offset;
+} StreamBlock;
+
+/*
+function used to write the quadtree of an image compressed in streaming
+mode, in pre-order, from the top block of its pyramid of blocks (level l
+with a single block); returns 0 on success and -1 if the temporary file 
+is truncated
+*/
+static int write_stream (StreamBlock **level, int l, FILE *spool, QTree *buffer, FILE *g)
+{
+    /*
+        level[l] stores the blocks with a side length of band << l pixels,
+        1 << (top - l) blocks on a line of the image; a block (i, j) of 
+        level l > 0 has the quarters (2i, 2j), (2i, 2j + 1), 
+        (2i + 1, 2j + 1) and (2i + 1, 2j) on level l - 1. in the stack,
+        'size' stores the level of the block and 'index' the index of 
+        its root in the nodes array of the whole quadtree
+    */
+
+    StreamBlock *block = NULL, *q = NULL;
+    QuadtreeNode node;
+    Pending stack[QT_STACK], b;
+    uint32_t k = 0, base = 0;
+    size_t line = 0;
+    int top = 0;
+
+    stack[top++] = (Pending) {0, 0, l, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        line = (size_t) 1 << (l - b.size);
+        block = &level[b.size][b.x * line + b.y];
+        base = b.index;
+
+        // copy the sub-quadtree built from the pixels, with shifted 
+        // indices
+        if(b.size == 0)
+        {
+            if(reserve_QTree(buffer, block->nodes) != 0 ||
+               fseeko(spool, block->offset, SEEK_SET) != 0 ||
+               fread(buffer->node_vector, sizeof(QuadtreeNode), 
+                     block->nodes, spool) != block->nodes)
+                return -1;
+
+            for(k = 0; k < block->nodes; k++)
+                if(buffer->node_vector[k].top_left != -1)
+                {
+                    buffer->node_vector[k].top_left += base;
+                    buffer->node_vector[k].top_right += base;
+                    buffer->node_vector[k].bottom_right += base;
+                    buffer->node_vector[k].bottom_left += base;
+                }
+
+            fwrite(buffer->node_vector, sizeof(QuadtreeNode), block->nodes,
+                   g);
+            continue;
+        }
+
+        block_score(&node, &block->sums, block->area);
+
+        // a block that was not divided has a single node
+        if(block->nodes == 1)
+        {
+            node.top_left = node.top_right = -1;
+            node.bottom_right = node.bottom_left = -1;
+            fwrite(&node, sizeof(QuadtreeNode), 1, g);
+            continue;
+        }
+
+        q = level[b.size - 1];
+        line = 2 * line;
+
+        node.top_left = base + 1;
+        node.top_right = node.top_left + q[(2 * b.x) * line + 2 * b.y].nodes;
+        node.bottom_right = node.top_right + 
+                            q[(2 * b.x) * line + 2 * b.y + 1].nodes;
+        node.bottom_left = node.bottom_right + 
+                           q[(2 * b.x + 1) * line + 2 * b.y + 1].nodes;
+        fwrite(&node, sizeof(QuadtreeNode), 1, g);
+
+        stack[top++] = (Pending) {2 * b.x + 1, 2 * b.y, b.size - 1, 
+                                  node.bottom_left, -1, 0};
+        stack[top++] = (Pending) {2 * b.x + 1, 2 * b.y + 1, b.size - 1, 
+                                  node.bottom_right, -1, 0};
+        stack[top++] = (Pending) {2 * b.x, 2 * b.y + 1, b.size - 1, 
+                                  node.top_right, -1, 0};
+        stack[top++] = (Pending) {2 * b.x, 2 * b.y, b.size - 1, 
+                                  node.top_left, -1, 0};
+    }
+
+    return 0;
+}
+
+/*
+function used to find the blocks above the ones of level 0 of a pyramid
+of blocks, level by level, from the colour sums of their quarters; n is
+the number of blocks on a line of level 0, which have a side length of
+'band' pixels
+*/
+static void build_levels (StreamBlock **level, int levels, int n, int band, int width, int height, int factor)
+{
+    int i = 0, j = 0, l = 0;
+
+    for(l = 1; l < levels; l++)
+    {
+        int m = n >> l;
+
+        for(i = 0; i < m; i++)
+            for(j = 0; j < m; j++)
+            {
+                StreamBlock *b = &level[l][(size_t) i * m + j];
+                StreamBlock *q[4];
+                QuadtreeNode node;
+                int k = 0;
+
+                q[0] = &level[l - 1][(size_t) (2 * i) * (2 * m) + 2 * j];
+                q[1] = &level[l - 1][(size_t) (2 * i) * (2 * m) + 2 * j + 1];
+                q[2] = &level[l - 1][(size_t) (2 * i + 1) * (2 * m) + 
+                                     2 * j + 1];
+                q[3] = &level[l - 1][(size_t) (2 * i + 1) * (2 * m) + 2 * j];
+
+                // colour sums of the block are the sums of its quarters
+                b->sums.red = b->sums.green = b->sums.blue = b->sums.sq = 0;
+                b->area = block_area(i * (band << l), j * (band << l), 
+                                     band << l, width, height);
+                b->nodes = 1;
+                b->leaves = 0;
+                for(k = 0; k < 4; k++)
+                {
+                    b->sums.red = b->sums.red + q[k]->sums.red;
+                    b->sums.green = b->sums.green + q[k]->sums.green;
+                    b->sums.blue = b->sums.blue + q[k]->sums.blue;
+                    b->sums.sq = b->sums.sq + q[k]->sums.sq;
+                    b->nodes = b->nodes + q[k]->nodes;
+                    b->leaves = b->leaves + q[k]->leaves;
+                }
+
+                // verify if similarity score is greater than 
+                // compression factor
+                if(block_score(&node, &b->sums, b->area) <= factor)
+                {
+                    b->nodes = 1;
+                    b->leaves = 1;
+                }
+            }
+    }
+}
+
+/*
+function used to compress a .ppm image without loading all its pixels; 
+the image is read in bands of 'band' lines (rounded down to a power of 
+two, and raised so that a line of the image has at most STREAM_BLOCKS
+blocks) and the compressed file is written in 'g'; returns 0 on success,
+-1 if the file is not a valid .ppm image and -2 if the temporary file of
+the sub-quadtrees cannot be used or is truncated
+*/
+int compress_stream (FILE *f, FILE *g, int band, int factor)
+{
+    /*
+        every band is divided into blocks of band * band pixels. the
+        sub-quadtree of each block is built from the summed-area table
+        of the block alone and stored in a temporary file, so only the
+        pixels of the current band are kept in memory.
+        the nodes above the blocks only depend on the colour sums of
+        their quarters, so they are found afterwards, level by level, and
+        the whole quadtree is written in pre-order, copying the stored
+        sub-quadtrees in place.
+        the blocks are clipped to the image like the ones of the quadtree,
+        so the last band may have less lines and the blocks outside the
+        image have no pixels.
+    */
+
+    int i = 0, j = 0, l = 0, n = 0, levels = 1;
+    int width = 0, height = 0, size = 0, lines = 0, status = 0;
+    size_t count = 0;
+    Grid grid, block;
+    SumTable table;
+    QTree tree;
+    StreamBlock **level = NULL;
+    FILE *spool = NULL;
+
+    if(read_header(&grid, f) != 0)
+        return -1;
+
+    width = grid.width;
+    height = grid.height;
+    size = quadtree_size(width, height);
+
+    // the side length of the blocks is a power of two 
+    // that divides the side length of the quadtree
+    while(band & (band - 1))
+        band = band & (band - 1);
+    if(band > size)
+        band = size;
+
+    // thin bands of a large image would need (size / band)^2 blocks
+    while((size / band) > STREAM_BLOCKS)
+        band = band * 2;
+
+    n = size / band;
+    while((band << (levels - 1)) < size)
+        levels++;
+
+    level = (StreamBlock **) malloc(levels * sizeof(StreamBlock *));
+    for(l = 0; l < levels; l++)
+        level[l] = (StreamBlock *) malloc((size_t) (n >> l) * (n >> l) * 
+                                         sizeof(StreamBlock));
+
+    spool = tmpfile();
+    if(spool == NULL)
+    {
+        for(l = 0; l < levels; l++)
+            free(level[l]);
+        free(level);
+        return -2;
+    }
+
+    alloc_grid(&block, width, band);
+    init_sum_table(&table);
+    init_QTree(&tree);
+
+    // read the image band by band and build the sub-quadtree of each block
+    for(i = 0; i < n; i++)
+    {
+        lines = clip_length(i * band, band, height);
+        count = (size_t) width * lines;
+        if(read_pixels(&grid, f, block.pixels, count) != 0)
+        {
+            free_grid(&block);
+            free_sum_table(&table);
+            free_QTree(&tree);
+            for(l = 0; l < levels; l++)
+                free(level[l]);
+            free(level);
+            fclose(spool);
+            return -1;
+        }
+
+        for(j = 0; j < n; j++)
+        {
+            StreamBlock *b = &level[0][(size_t) i * n + j];
+
+            // the block is a view of the band, with the same stride
+            grid.width = clip_length(j * band, band, width);
+            grid.height = lines;
+            grid.stride = width;
+            grid.pixels = block.pixels + ((grid.width > 0) ? j * band : 0);
+
+            build_sum_table(&table, &grid);
+            tree.nodes = 0;
+            tree.leaves = 0;
+            build_QTree_c(&tree, &table, 0, 0, band, factor);
+            b->area = block_sums(&table, 0, 0, band, &b->sums);
+
+            b->nodes = tree.nodes;
+            b->leaves = tree.leaves;
+            b->offset = ftello(spool);
+            fwrite(tree.node_vector, sizeof(QuadtreeNode), tree.nodes, spool);
+        }
+    }
+
+    // find the nodes above the blocks, level by level
+    build_levels(level, levels, n, band, width, height, factor);
+
+    // write the number of leaf nodes, the total number of nodes
+    // and the nodes array
+    fwrite(&level[levels - 1][0].leaves, sizeof(uint32_t), 1, g);
+    fwrite(&level[levels - 1][0].nodes, sizeof(uint32_t), 1, g);
+    if(write_stream(level, levels - 1, spool, &tree, g) != 0)
+        status = -2;
+    else
+        write_dimensions(width, height, 0, 0, g);
+
+    free_grid(&block);
+    free_sum_table(&table);
+    free_QTree(&tree);
+    for(l = 0; l < levels; l++)
+        free(level[l]);
+    free(level);
+    fclose(spool);
+
+    return status;
+}
+
+/*
+function used to initialize the empty tiles of an image
+*/
+void init_tiles (Tiles *tiles)
+{
+    tiles->width = 0;
+    tiles->height = 0;
+    tiles->factor = 0;
+    tiles->tile = 0;
+    tiles->count = 0;
+    tiles->hash = NULL;
+    tiles->sums = NULL;
+    tiles->start = NULL;
+    init_QTree(&tiles->tree);
+}
+
+/*
+function used to free the tiles of an image
+*/
+void free_tiles (Tiles *tiles)
+{
+    free(tiles->hash);
+    free(tiles->sums);
+    free(tiles->start);
+    free_QTree(&tiles->tree);
+    init_tiles(tiles);
+}
+
+/*
+function used to allocate the tiles of an image with given dimensions;
+returns 0 on success and -1 if the memory cannot be allocated
+*/
+static int alloc_tiles (Tiles *tiles, int width, int height, int factor, int tile)
+{
+    size_t count = 0;
+
+    tiles->width = width;
+    tiles->height = height;
+    tiles->factor = factor;
+    tiles->tile = tile;
+    tiles->count = quadtree_size(width, height) / tile;
+
+    count = (size_t) tiles->count * tiles->count;
+    tiles->hash = (uint64_t *) malloc(count * sizeof(uint64_t));
+    tiles->sums = (moments *) malloc(count * sizeof(moments));
+    tiles->start = (uint32_t *) malloc((count + 1) * sizeof(uint32_t));
+    init_QTree(&tiles->tree);
+
+    if(tiles->hash == NULL || tiles->sums == NULL || tiles->start == NULL)
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to read the tiles of an image from a state file; returns
+0 on success and -1 if the file is not valid
+*/
+int load_tiles (Tiles *tiles, FILE *f)
+{
+    /*
+        the file starts with the 4 bytes of TILES_MAGIC, the width and
+        height of the image, the compression factor, the side length of
+        the tiles and their number on a line of the quadtree (4 bytes 
+        each); then the hashes, the colour sums and the start indices of
+        the tiles, and the nodes of all their sub-quadtrees
+    */
+
+    unsigned char magic[4];
+    int32_t header[5];
+    size_t count = 0;
+    off_t remaining = -1;
+    uint32_t i = 0, nodes = 0, leaves = 0;
+    struct stat info;
+
+    init_tiles(tiles);
+    if(fread(magic, 1, 4, f) != 4 || memcmp(magic, TILES_MAGIC, 4) != 0 ||
+       fread(header, sizeof(int32_t), 5, f) != 5 || header[0] <= 0 || 
+       header[0] > (1 << QT_MAX_LEVEL) || header[1] <= 0 || 
+       header[1] > (1 << QT_MAX_LEVEL) ||
+       header[3] <= 0 || (header[3] & (header[3] - 1)) != 0 ||
+       header[3] > quadtree_size(header[0], header[1]) ||
+       header[4] != quadtree_size(header[0], header[1]) / header[3])
+        return -1;
+
+    // the tables of the tiles and their nodes cannot be longer than the
+    // rest of the file, so a damaged header does not allocate more
+    count = (size_t) header[4] * header[4];
+    if(fstat(fileno(f), &info) == 0 && S_ISREG(info.st_mode))
+        remaining = info.st_size - ftello(f);
+    if(remaining >= 0 &&
+       (uint64_t) remaining < count * (sizeof(uint64_t) + sizeof(moments) +
+                                       sizeof(uint32_t)) + sizeof(uint32_t))
+        return -1;
+
+    if(alloc_tiles(tiles, header[0], header[1], header[2], header[3]) != 0 ||
+       fread(tiles->hash, sizeof(uint64_t), count, f) != count ||
+       fread(tiles->sums, sizeof(moments), count, f) != count ||
+       fread(tiles->start, sizeof(uint32_t), count + 1, f) != count + 1 ||
+       tiles->start[0] != 0)
+    {
+        free_tiles(tiles);
+        return -1;
+    }
+
+    // every tile has at least a node, so the start indices increase up
+    // to the total number of nodes
+    for(i = 0; i < count; i++)
+        if(tiles->start[i + 1] <= tiles->start[i])
+        {
+            free_tiles(tiles);
+            return -1;
+        }
+
+    nodes = tiles->start[count];
+    if(remaining >= 0)
+        remaining = remaining - count * (sizeof(uint64_t) + sizeof(moments) +
+                                         sizeof(uint32_t)) - sizeof(uint32_t);
+    if((remaining >= 0 && 
+        (uint64_t) nodes * sizeof(QuadtreeNode) > (uint64_t) remaining) ||
+       reserve_QTree(&tiles->tree, nodes) != 0 ||
+       fread(tiles->tree.node_vector, sizeof(QuadtreeNode), nodes, f) != 
+       nodes)
+    {
+        free_tiles(tiles);
+        return -1;
+    }
+    tiles->tree.nodes = nodes;
+
+    // the sub-quadtree of every tile is the one of its block, with child
+    // indices inside the tile, so it can be reused without checks
+    for(i = 0; i < count; i++)
+    {
+        int line = (i / tiles->count) * tiles->tile;
+        int column = (i % tiles->count) * tiles->tile;
+
+        if(check_block(tiles->tree.node_vector + tiles->start[i],
+                       tiles->start[i + 1] - tiles->start[i], 0, 0, 
+                       tiles->tile,
+                       clip_length(column, tiles->tile, tiles->width),
+                       clip_length(line, tiles->tile, tiles->height),
+                       &leaves) != 0)
+        {
+            free_tiles(tiles);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+function used to write the tiles of an image in a state file
+*/
+void save_tiles (Tiles *tiles, FILE *g)
+{
+    int32_t header[5] = {tiles->width, tiles->height, tiles->factor,
+                         tiles->tile, tiles->count};
+    size_t count = (size_t) tiles->count * tiles->count;
+
+    fwrite(TILES_MAGIC, 1, 4, g);
+    fwrite(header, sizeof(int32_t), 5, g);
+    fwrite(tiles->hash, sizeof(uint64_t), count, g);
+    fwrite(tiles->sums, sizeof(moments), count, g);
+    fwrite(tiles->start, sizeof(uint32_t), count + 1, g);
+    fwrite(tiles->tree.node_vector, sizeof(QuadtreeNode), 
+           tiles->tree.nodes, g);
+}
+
+/*
+function used to find the hash of the pixels of a pixels matrix, 8 bytes
+at a time
+*/
+static uint64_t hash_grid (Grid *grid)
+{
+    int i = 0;
+    size_t k = 0, length = (size_t) grid->width * sizeof(pixel);
+    uint64_t hash = 0x9e3779b97f4a7c15ull, word = 0;
+    unsigned char *p = NULL;
+
+    for(i = 0; i < grid->height; i++)
+    {
+        p = (unsigned char *) grid_line(grid, i);
+
+        for(k = 0; k + 8 <= length; k = k + 8)
+        {
+            memcpy(&word, p + k, 8);
+            hash = (hash ^ (word * 0xff51afd7ed558ccdull)) * 
+                   0xc4ceb9fe1a85ec53ull;
+            hash = hash ^ (hash >> 29);
+        }
+
+        // the bytes at the end of the line
+        for(; k < length; k++)
+            hash = (hash ^ p[k]) * 0x100000001b3ull;
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+/*
+function used to append the nodes of a sub-quadtree to the nodes array
+of a quadtree; if 'shift' is 1, their child indices are shifted by the
+index of the first one; returns the number of leaf nodes copied
+*/
+static uint32_t append_nodes (QTree *tree, QuadtreeNode *nodes, uint32_t count, int shift)
+{
+    uint32_t k = 0, leaves = 0, base = tree->nodes;
+    QuadtreeNode *node = NULL;
+
+    reserve_QTree(tree, tree->nodes + count);
+    memcpy(tree->node_vector + base, nodes, count * sizeof(QuadtreeNode));
+    tree->nodes = tree->nodes + count;
+
+    for(k = 0; k < count; k++)
+    {
+        node = &tree->node_vector[base + k];
+        if(node->top_left == -1)
+            leaves++;
+        else if(shift)
+        {
+            node->top_left = node->top_left + base;
+            node->top_right = node->top_right + base;
+            node->bottom_right = node->bottom_right + base;
+            node->bottom_left = node->bottom_left + base;
+        }
+    }
+
+    return leaves;
+}
+
+/*
+function used to build the nodes of the compression quadtree from the 
+top block of a pyramid of blocks (level l with a single block), in 
+pre-order, copying the sub-quadtrees of the tiles at level 0
+*/
+static void build_pyramid (QTree *tree, Tiles *tiles, StreamBlock **level, int l)
+{
+    // 'size' stores the level of the block, which is block (x, y) of a
+    // level with 1 << (l - size) blocks on a line
+    StreamBlock *block = NULL;
+    Pending stack[QT_STACK], b;
+    size_t t = 0;
+    int index = 0, top = 0;
+
+    stack[top++] = (Pending) {0, 0, l, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        t = ((size_t) b.x << (l - b.size)) + b.y;
+        block = &level[b.size][t];
+        if(b.parent != -1)
+            set_child(&tree->node_vector[b.parent], b.child, tree->nodes);
+
+        // the sub-quadtree of a tile has relative child indices
+        if(b.size == 0)
+        {
+            tree->leaves = tree->leaves + 
+                append_nodes(tree, tiles->tree.node_vector + tiles->start[t],
+                             tiles->start[t + 1] - tiles->start[t], 1);
+            continue;
+        }
+
+        index = add_node(tree);
+        block_score(&tree->node_vector[index], &block->sums, block->area);
+
+        // a block that was not divided has a single node
+        if(block->nodes == 1)
+        {
+            set_leaf(tree, index);
+            continue;
+        }
+
+        stack[top++] = (Pending) {2 * b.x + 1, 2 * b.y, b.size - 1, 0, 
+                                  index, 3};
+        stack[top++] = (Pending) {2 * b.x + 1, 2 * b.y + 1, b.size - 1, 0, 
+                                  index, 2};
+        stack[top++] = (Pending) {2 * b.x, 2 * b.y + 1, b.size - 1, 0, 
+                                  index, 1};
+        stack[top++] = (Pending) {2 * b.x, 2 * b.y, b.size - 1, 0, index, 0};
+    }
+}
+
+/*
+function used to build compression quadtree of an image that is divided
+into tiles, reusing the sub-quadtrees of the tiles that did not change
+since the previous image ('old', which may have no tiles); the tiles of
+the image are stored in 'tiles' for the next one
+*/
+void build_QTree_tiles (QTree *tree, Grid *grid, int factor, int tile, Tiles *old, Tiles *tiles)
+{
+    /*
+        the hash of every tile is compared with the one of the same tile
+        of the previous image. a tile that did not change keeps its
+        sub-quadtree and its colour sums; for the other ones, they are
+        found from the summed-area table of the tile alone, like for the
+        "-s" option. the nodes above the tiles only depend on the colour
+        sums of their quarters, so they are always found again, level by
+        level, and the whole quadtree is built in pre-order.
+    */
+
+    int i = 0, j = 0, l = 0, levels = 1, n = 0;
+    int size = quadtree_size(grid->width, grid->height);
+    int reuse = 0;
+    size_t t = 0;
+    Grid view;
+    SumTable table;
+    QTree sub;
+    StreamBlock **level = NULL;
+
+    // the side length of the tiles is a power of two
+    while(tile & (tile - 1))
+        tile = tile & (tile - 1);
+    if(tile > size)
+        tile = size;
+    if(tile < 1)
+        tile = 1;
+
+    reuse = (old->count > 0 && old->width == grid->width && 
+             old->height == grid->height && old->factor == factor &&
+             old->tile == tile);
+
+    alloc_tiles(tiles, grid->width, grid->height, factor, tile);
+    n = tiles->count;
+    while((tile << (levels - 1)) < size)
+        levels++;
+
+    level = (StreamBlock **) malloc(levels * sizeof(StreamBlock *));
+    for(l = 0; l < levels; l++)
+        level[l] = (StreamBlock *) malloc((size_t) (n >> l) * (n >> l) * 
+                                         sizeof(StreamBlock));
+
+    init_sum_table(&table);
+    init_QTree(&sub);
+    tiles->start[0] = 0;
+
+    for(i = 0; i < n; i++)
+        for(j = 0; j < n; j++)
+        {
+            StreamBlock *b = &level[0][(size_t) i * n + j];
+
+            // the tile is a view of the pixels matrix, clipped to it
+            t = (size_t) i * n + j;
+            view.width = clip_length(j * tile, tile, grid->width);
+            view.height = clip_length(i * tile, tile, grid->height);
+            view.stride = grid->stride;
+            view.pixels = grid->pixels;
+            if(view.width > 0 && view.height > 0)
+                view.pixels = grid_line(grid, i * tile) + j * tile;
+
+            tiles->hash[t] = hash_grid(&view);
+            b->area = (uint32_t) view.width * view.height;
+
+            // the sub-quadtrees of the tiles keep child indices that
+            // are relative to their roots
+            if(reuse && old->hash[t] == tiles->hash[t])
+            {
+                // copy the sub-quadtree of the previous image
+                tiles->sums[t] = old->sums[t];
+                b->leaves = append_nodes(&tiles->tree, old->tree.node_vector +
+                                         old->start[t], old->start[t + 1] - 
+                                         old->start[t], 0);
+            }
+            else
+            {
+                build_sum_table(&table, &view);
+                sub.nodes = 0;
+                sub.leaves = 0;
+                build_QTree_c(&sub, &table, 0, 0, tile, factor);
+                block_sums(&table, 0, 0, tile, &tiles->sums[t]);
+                b->leaves = append_nodes(&tiles->tree, sub.node_vector, 
+                                         sub.nodes, 0);
+            }
+
+            tiles->start[t + 1] = tiles->tree.nodes;
+            b->sums = tiles->sums[t];
+            b->nodes = tiles->start[t + 1] - tiles->start[t];
+        }
+
+    // find the nodes above the tiles and build the whole quadtree
+    build_levels(level, levels, n, tile, grid->width, grid->height, factor);
+    tree->nodes = 0;
+    tree->leaves = 0;
+    build_pyramid(tree, tiles, level, levels - 1);
+
+    free_sum_table(&table);
+    free_QTree(&sub);
+    for(l = 0; l < levels; l++)
+        free(level[l]);
+    free(level);
+}
@@ -2,6 +2,22 @@
 #define HEADER_H
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include "pool.h"
+
+/*
+geometric transforms of an image ("-x TYPE"); the rotations are clockwise
+*/
+enum
+{
+    TRANSFORM_V,
+    TRANSFORM_H,
+    TRANSFORM_T,
+    TRANSFORM_90,
+    TRANSFORM_180,
+    TRANSFORM_270,
+    TRANSFORMS
+};
 
 /*
 structure of pixel
@@ -14,23 +30,64 @@ typedef struct pixel
 } __attribute__ ((packed)) pixel;
 
 /*
-structure of quadtree
+structure of pixels matrix
 
-q1 = child node that represents the top-left sub-area
-q2 = child node that represents the top-right sub-area
-q3 = child node that represents the bottom-right sub-area
-q4 = child node that represents the bottom-left sub-area
+the pixels of line i start at pixels + i * stride (stride >= width);
+they are stored contiguously, either inside the memory mapped input file
+or in an allocated matrix
+
+format, max_color = type of the input file ("P3", "P5" or "P6", see 
+"ppm.h") and largest value of its samples; the pixels matrix always has
+samples of 8 bits, to which the ones of the file are scaled
+
+data, data_size = memory mapping of the input file
+mapped = 1 if the pixels are stored inside 'data'
+
+in the tiled layout ("-Z SIZE"), 'tile' is the side length of the tiles 
+(a power of two) and 'stride' is the number of tiles on a line; the tiles
+are stored one after another, line by line, and the pixels of each tile
+are stored in Z-order (the top-left, top-right, bottom-left and 
+bottom-right quarters one after another, and so on), so the pixels of 
+every block of the quadtree that fits in a tile are contiguous; 'tile' 
+is 0 for the layout line by line
 */
-typedef struct QTree
+typedef struct Grid
 {
-    uint8_t red;
-    uint8_t green;
-    uint8_t blue;
-    struct QTree *q1, *q2, *q3, *q4;
-} QTree;
+    pixel *pixels;
+    int width, height, stride;
+    int format, max_color;
+    unsigned char *data;
+    size_t data_size;
+    int mapped;
+    int tile;
+} Grid;
+
+/*
+function used to find the first pixel of a line of the pixels matrix
+*/
+static inline pixel *grid_line (Grid *grid, int i)
+{
+    return grid->pixels + (size_t) i * grid->stride;
+}
+
+/*
+function used to find the first pixel of the tile that contains the
+element grid[i][j] of a pixels matrix in the tiled layout
+*/
+static inline pixel *grid_tile (Grid *grid, int i, int j)
+{
+    return grid->pixels + ((size_t) (i / grid->tile) * grid->stride + 
+                           j / grid->tile) * grid->tile * grid->tile;
+}
 
 /*
 structure of node array element
+
+area = number of pixels of the image inside the block of the node (0 for
+       the blocks outside an image whose side lengths are not equal to
+       the one of its quadtree)
+top_left, top_right, bottom_left, bottom_right = indices of the child
+nodes in the array (-1 for a leaf node)
 */
 typedef struct QuadtreeNode
 {
@@ -40,22 +97,202 @@ typedef struct QuadtreeNode
     int32_t bottom_left, bottom_right;
 } __attribute__ ((packed)) QuadtreeNode;
 
-void init_QTree (QTree **tree);
-void build_QTree_c (QTree *tree, pixel **grid, int x, int y, int size, int factor);
-void build_QTree_d (QTree *tree, QuadtreeNode *node_vector, int index);
-void free_QTree (QTree **tree);
+/*
+structure of quadtree
 
-void build_grid_c (pixel ***grid, int *width, int *height, int *max_color, FILE *f);
-void build_grid_d (QTree *tree, pixel **grid, int x, int y, int size);
+the quadtree is stored as its array of nodes, in the same layout as the
+one of the compressed file: the root is the first element and every node
+is followed by the sub-quadtrees of its children, in pre-order
+(top-left, top-right, bottom-right, bottom-left)
 
-void build_vector (QTree *tree, QuadtreeNode *node_vector, int k, int depth, int *index_v);
+the root covers a square with a side length that is a power of two; an
+image with other dimensions is placed in its top-left corner and every
+block is clipped to the image, so the blocks outside it are leaf nodes 
+with no pixels; a transform ("-x") can move the image to another corner,
+which is recorded in 'line' and 'column' instead of moving the nodes
 
-uint32_t num_leaves (QTree *tree);
-uint32_t num_nodes (QTree *tree);
+nodes = number of nodes in the array
+leaves = number of leaf nodes
+capacity = number of nodes the array can store before it is enlarged
+line, column = position of the top-left pixel of the image in the square
+               of the root (0 for a quadtree built from an image)
+*/
+typedef struct QTree
+{
+    QuadtreeNode *node_vector;
+    uint32_t nodes, leaves;
+    uint32_t capacity;
+    int line, column;
+} QTree;
+
+/*
+the images have at most 2^QT_MAX_LEVEL pixels on each side, so a quadtree
+has at most QT_MAX_LEVEL + 1 levels; a traversal that descends one level
+at a time keeps at most 3 siblings waiting at each level, so its stack
+never has more than QT_STACK elements
+*/
+#define QT_MAX_LEVEL 15
+#define QT_STACK (3 * QT_MAX_LEVEL + 4)
+
+/*
+structure of block waiting in the stack of a traversal of a quadtree
+
+x, y = line and column of the top-left element of the block
+size = side length of the block (or its level, or its depth)
+index = index of its node
+parent = index of the node of its parent (-1 for the root)
+child = which child of the parent it is (0 = top-left, 1 = top-right,
+        2 = bottom-right, 3 = bottom-left)
+*/
+typedef struct Pending
+{
+    int x, y, size;
+    int32_t index, parent;
+    int child;
+} Pending;
+
+/*
+function used to set the index of a child of a node
+*/
+static inline void set_child (QuadtreeNode *node, int child, int32_t index)
+{
+    if(child == 0)
+        node->top_left = index;
+    else if(child == 1)
+        node->top_right = index;
+    else if(child == 2)
+        node->bottom_right = index;
+    else
+        node->bottom_left = index;
+}
+
+/*
+structure of summed-area table entry
+
+red, green, blue = sums of the colour values inside the rectangle that
+                   has grid[0][0] as top-left element
+sq = sum of the squared colour values (all three colours) inside the
+     same rectangle
+*/
+typedef struct moments
+{
+    uint64_t red, green, blue;
+    uint64_t sq;
+} moments;
+
+/*
+structure of summed-area table (integral image) of the pixels matrix
+
+entry[i * (width + 1) + j] covers the lines 0..i-1 and columns 0..j-1,
+so the first line and column of the table are zero
+*/
+typedef struct SumTable
+{
+    int width, height;
+    size_t capacity;
+    moments *entry;
+} SumTable;
+
+/*
+structure of the targets of the rate controlled construction of the
+quadtree ("-S BYTES" and "-P DB" options)
+
+bytes = largest size of the compressed file (0 if there is no target)
+psnr = smallest peak signal-to-noise ratio of the image, in decibels
+       (0 if there is no target)
+compact = 1 if the compressed file is written in the compact format
+*/
+typedef struct Budget
+{
+    size_t bytes;
+    double psnr;
+    int compact;
+} Budget;
+
+/*
+structure of the tiles of an image compressed incrementally ("-I FILE")
+
+the quadtree square is divided into count * count tiles with a side
+length of 'tile' pixels (a power of two); the tiles are stored in a state
+file, so the tiles of the next image that did not change keep their
+sub-quadtrees
+
+width, height, factor = image and compression factor of the tiles
+hash[t], sums[t] = hash of the pixels and colour sums of tile t (the
+                   tiles are numbered line by line)
+start[t] = index of the root of the sub-quadtree of tile t in 'tree';
+           its nodes end at start[t + 1]
+tree = nodes of the sub-quadtrees of all tiles, with child indices that
+       are relative to the root of their tile
+*/
+#define TILES_MAGIC "\x89QTI"
+
+typedef struct Tiles
+{
+    int width, height, factor;
+    int tile, count;
+    uint64_t *hash;
+    moments *sums;
+    uint32_t *start;
+    QTree tree;
+} Tiles;
+
+/*
+structure of view of an image rendered from its quadtree
+
+size = side length of the square covered by the quadtree
+shift = the image is reduced 2^shift times (every block of 2^shift *
+        2^shift pixels becomes a single pixel)
+lines, columns = dimensions of the whole reduced image
+line, column, width, height = rectangle of the square of the reduced 
+                              quadtree that is rendered
+*/
+typedef struct View
+{
+    int size, shift;
+    int lines, columns;
+    int line, column;
+    int width, height;
+} View;
+
+void init_sum_table (SumTable *table);
+void build_sum_table (SumTable *table, Grid *grid);
+void free_sum_table (SumTable *table);
+
+int quadtree_size (int width, int height);
+uint32_t block_area (int x, int y, int size, int width, int height);
+int check_block (QuadtreeNode *nodes, uint32_t count, int x, int y, int size, int width, int height, uint32_t *leaves);
+
+void init_QTree (QTree *tree);
+int reserve_QTree (QTree *tree, uint32_t capacity);
+void free_QTree (QTree *tree);
+void build_QTree_c (QTree *tree, SumTable *table, int x, int y, int size, int factor);
+void build_QTree_b (QTree *tree, Grid *grid, int size, int factor);
+void build_QTree_rate (QTree *tree, SumTable *table, int size, int factor, Budget *budget);
+
+int build_grid_c (Grid *grid, FILE *f);
+int build_grid_t (Grid *grid, FILE *f, int tile);
+void alloc_grid (Grid *grid, int width, int height);
+void free_grid (Grid *grid);
+void init_view (View *view, QTree *tree, int width, int height, int shift);
+void render_lines (QTree *tree, View *view, int first, int count, pixel *lines);
+
+void build_QTree_c_parallel (QTree *tree, SumTable *table, int size, int factor, int threshold, ThreadPool *pool);
+void render_lines_parallel (QTree *tree, View *view, int first, int count, pixel *lines, int band, ThreadPool *pool);
+void render_view_parallel (QTree *tree, View *view, pixel *image, int threshold, ThreadPool *pool);
+
+int compress_stream (FILE *f, FILE *g, int band, int factor);
+
+void init_tiles (Tiles *tiles);
+int load_tiles (Tiles *tiles, FILE *f);
+void save_tiles (Tiles *tiles, FILE *g);
+void free_tiles (Tiles *tiles);
+void build_QTree_tiles (QTree *tree, Grid *grid, int factor, int tile, Tiles *old, Tiles *tiles);
 
 void flip_vertical (QTree *tree);
 void flip_horizontal (QTree *tree);
+void transform_QTree (QTree *tree, int type);
+void order_QTree (QTree *tree);
+void transform_image (QTree *tree, int type, int *width, int *height);
 
-int log_two(int x);
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "kernels.h"
+
+#ifdef X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*
+function used to add the pixels from..width - 1 of a line to its sums
+('line') and to compute the entries of the summed-area table that
+correspond to them
+*/
+static inline void sum_pixels (pixel *p, int from, int width, moments *line, moments *above, moments *current)
+{
+    int j = 0;
+
+    for(j = from; j < width; j++)
+    {
+        line->red = line->red + p[j].red;
+        line->green = line->green + p[j].green;
+        line->blue = line->blue + p[j].blue;
+        line->sq = line->sq +
+                   p[j].red * p[j].red +
+                   p[j].green * p[j].green +
+                   p[j].blue * p[j].blue;
+
+        // add the sums of the lines above
+        current[j + 1].red = above[j + 1].red + line->red;
+        current[j + 1].green = above[j + 1].green + line->green;
+        current[j + 1].blue = above[j + 1].blue + line->blue;
+        current[j + 1].sq = above[j + 1].sq + line->sq;
+    }
+}
+
+/*
+function used to compute a line of the summed-area table one pixel at
+a time
+*/
+void sum_line_scalar (pixel *p, int width, moments *above, moments *current)
+{
+    // sums of the current line, up to column j
+    moments line = {0, 0, 0, 0};
+
+    current[0] = above[0];
+    sum_pixels(p, 0, width, &line, above, current);
+}
+
+#ifdef X86_KERNELS
+
+/*
+function used to separate the colours of 8 packed pixels (24 bytes) into
+three vectors of 16-bit values, one for each colour
+*/
+__attribute__ ((target ("sse4.1")))
+static inline void split_pixels (pixel *p, __m128i *red, __m128i *green, __m128i *blue)
+{
+    /*
+        the first 16 bytes hold the first 5 pixels and the red value of
+        the sixth one, the next 8 bytes hold the rest; each shuffle mask
+        moves the bytes of one colour to the low half of 16-bit lanes
+        (-1 clears a byte), so exactly 24 bytes are read
+    */
+
+    __m128i a = _mm_loadu_si128((__m128i *) p);
+    __m128i b = _mm_loadl_epi64((__m128i *) ((unsigned char *) p + 16));
+
+    *red = _mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1,
+                                          12, -1, 15, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, -1, -1, 2, -1, 5, -1)));
+    *green = _mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1,
+                                          13, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, 0, -1, 3, -1, 6, -1)));
+    *blue = _mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1,
+                                          14, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, 1, -1, 4, -1, 7, -1)));
+}
+
+/*
+function used to compute a line of the summed-area table with SSE4.1
+instructions; the sums are kept in two vectors of 64-bit values,
+(red, green) and (blue, sq)
+*/
+__attribute__ ((target ("sse4.1")))
+void sum_line_sse41 (pixel *p, int width, moments *above, moments *current)
+{
+    int i = 0, j = 0, k = 0;
+    __m128i red, green, blue, half[4], pix[4];
+    __m128i line_rg = _mm_setzero_si128(), line_bs = _mm_setzero_si128();
+    __m128i *a = (__m128i *) above, *c = (__m128i *) current;
+    moments line;
+
+    current[0] = above[0];
+
+    for(j = 0; j + 8 <= width; j = j + 8)
+    {
+        split_pixels(&p[j], &red, &green, &blue);
+
+        for(k = 0; k < 2; k++)
+        {
+            // 32-bit values of 4 pixels; the squares fit in 16 bits,
+            // their sums need 32 bits
+            half[0] = _mm_cvtepu16_epi32(red);
+            half[1] = _mm_cvtepu16_epi32(green);
+            half[2] = _mm_cvtepu16_epi32(blue);
+            half[3] = _mm_add_epi32(
+                _mm_add_epi32(_mm_cvtepu16_epi32(_mm_mullo_epi16(red, red)),
+                              _mm_cvtepu16_epi32(_mm_mullo_epi16(green, green))),
+                _mm_cvtepu16_epi32(_mm_mullo_epi16(blue, blue)));
+
+            // transpose to (red, green, blue, sq) for every pixel
+            pix[0] = _mm_unpacklo_epi32(half[0], half[1]);
+            pix[1] = _mm_unpackhi_epi32(half[0], half[1]);
+            pix[2] = _mm_unpacklo_epi32(half[2], half[3]);
+            pix[3] = _mm_unpackhi_epi32(half[2], half[3]);
+            half[0] = _mm_unpacklo_epi64(pix[0], pix[2]);
+            half[1] = _mm_unpackhi_epi64(pix[0], pix[2]);
+            half[2] = _mm_unpacklo_epi64(pix[1], pix[3]);
+            half[3] = _mm_unpackhi_epi64(pix[1], pix[3]);
+
+            for(i = 0; i < 4; i++)
+            {
+                int col = j + 4 * k + i + 1;
+
+                line_rg = _mm_add_epi64(line_rg, _mm_cvtepu32_epi64(half[i]));
+                line_bs = _mm_add_epi64(line_bs,
+                              _mm_cvtepu32_epi64(_mm_srli_si128(half[i], 8)));
+
+                // add the sums of the lines above
+                _mm_storeu_si128(&c[2 * col],
+                    _mm_add_epi64(_mm_loadu_si128(&a[2 * col]), line_rg));
+                _mm_storeu_si128(&c[2 * col + 1],
+                    _mm_add_epi64(_mm_loadu_si128(&a[2 * col + 1]), line_bs));
+            }
+
+            // the next 4 pixels
+            red = _mm_srli_si128(red, 8);
+            green = _mm_srli_si128(green, 8);
+            blue = _mm_srli_si128(blue, 8);
+        }
+    }
+
+    // the last pixels of the line are added one at a time
+    _mm_storeu_si128((__m128i *) &line.red, line_rg);
+    _mm_storeu_si128((__m128i *) &line.blue, line_bs);
+    sum_pixels(p, j, width, &line, above, current);
+}
+
+/*
+function used to compute a line of the summed-area table with AVX2
+instructions; an entry of the table (4 values of 64 bits) fits in a
+single vector
+*/
+__attribute__ ((target ("avx2")))
+void sum_line_avx2 (pixel *p, int width, moments *above, moments *current)
+{
+    int i = 0, j = 0;
+    __m128i red, green, blue;
+    __m256i all[4], pix[4];
+    __m256i sums = _mm256_setzero_si256();
+    __m256i *a = (__m256i *) above, *c = (__m256i *) current;
+    moments line;
+
+    current[0] = above[0];
+
+    for(j = 0; j + 8 <= width; j = j + 8)
+    {
+        split_pixels(&p[j], &red, &green, &blue);
+
+        // 32-bit values of the 8 pixels
+        all[0] = _mm256_cvtepu16_epi32(red);
+        all[1] = _mm256_cvtepu16_epi32(green);
+        all[2] = _mm256_cvtepu16_epi32(blue);
+        all[3] = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_mullo_epi16(red, red)),
+                             _mm256_cvtepu16_epi32(_mm_mullo_epi16(green, green))),
+            _mm256_cvtepu16_epi32(_mm_mullo_epi16(blue, blue)));
+
+        /*
+            transpose to (red, green, blue, sq) for every pixel; vector i
+            holds pixel i in its low half and pixel i + 4 in its high half
+        */
+        pix[0] = _mm256_unpacklo_epi32(all[0], all[1]);
+        pix[1] = _mm256_unpackhi_epi32(all[0], all[1]);
+        pix[2] = _mm256_unpacklo_epi32(all[2], all[3]);
+        pix[3] = _mm256_unpackhi_epi32(all[2], all[3]);
+        all[0] = _mm256_unpacklo_epi64(pix[0], pix[2]);
+        all[1] = _mm256_unpackhi_epi64(pix[0], pix[2]);
+        all[2] = _mm256_unpacklo_epi64(pix[1], pix[3]);
+        all[3] = _mm256_unpackhi_epi64(pix[1], pix[3]);
+
+        for(i = 0; i < 8; i++)
+        {
+            __m128i one = (i < 4) ? _mm256_castsi256_si128(all[i]) :
+                                    _mm256_extracti128_si256(all[i - 4], 1);
+
+            sums = _mm256_add_epi64(sums, _mm256_cvtepu32_epi64(one));
+
+            // add the sums of the lines above
+            _mm256_storeu_si256(&c[j + i + 1],
+                _mm256_add_epi64(_mm256_loadu_si256(&a[j + i + 1]), sums));
+        }
+    }
+
+    // the last pixels of the line are added one at a time
+    _mm256_storeu_si256((__m256i *) &line, sums);
+    sum_pixels(p, j, width, &line, above, current);
+}
+
+#endif
+
+/*
+function used to choose the fastest kernel supported by the processor
+*/
+line_kernel select_line_kernel (void)
+{
+    line_kernel kernel = sum_line_scalar;
+
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        kernel = sum_line_avx2;
+    else if(__builtin_cpu_supports("sse4.1"))
+        kernel = sum_line_sse41;
+#endif
+
+    return kernel;
+}
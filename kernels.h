@@ -0,0 +1,24 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include "header.h"
+
+// the vectorized kernels are only built for x86 processors
+#if defined(__x86_64__) || defined(__i386__)
+#define X86_KERNELS 1
+#endif
+
+/*
+function used to compute a line of the summed-area table: current[j] =
+above[j] + the sums of the first j pixels of the line, for j = 0..width
+*/
+typedef void (*line_kernel) (pixel *p, int width, moments *above, moments *current);
+
+void sum_line_scalar (pixel *p, int width, moments *above, moments *current);
+#ifdef X86_KERNELS
+void sum_line_sse41 (pixel *p, int width, moments *above, moments *current);
+void sum_line_avx2 (pixel *p, int width, moments *above, moments *current);
+#endif
+
+line_kernel select_line_kernel (void);
+
+#endif
@@ -3,168 +3,1041 @@
 #include <string.h>
 #include <inttypes.h>
 #include <math.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "header.h"
+#include "codec.h"
+#include "stats.h"
+#include "query.h"
+#include "ppm.h"
 
-int main(int argc, char *argv[])
+/*
+structure of command options
+*/
+typedef struct options
 {
-    int i = 0;
+    // build the compression quadtree bottom-up ("-b")
+    int bottom_up;
+    // side length of the tiles of the tiled layout of the pixels
+    // matrix ("-Z SIZE", 0 for the layout line by line)
+    int tile;
+    // number of worker threads ("-j N")
+    int threads;
+    // side length of the smallest block processed by a separate
+    // task ("-t SIZE")
+    int threshold;
+    // number of lines of the bands read when compressing in
+    // streaming mode ("-s ROWS", 0 to read the whole image)
+    int band;
+    // write the compressed file in the compact format ("-z")
+    int compact;
+    // write the compressed file in the progressive format ("-p")
+    int progressive;
+    // largest size of the compressed file ("-S BYTES", 0 for none)
+    size_t target_size;
+    // smallest PSNR of the compressed image ("-P DB", 0 for none)
+    double target_psnr;
+    // file with the list of images to compress ("-L FILE")
+    char *list;
+    // state file with the tiles of the previous image, for the
+    // incremental compression ("-I FILE")
+    char *state;
+    // print the statistics of the operation ("--stats")
+    int stats;
+    // the output image is reduced 2^shift times ("-l SHIFT")
+    int shift;
+    // rectangle of the output image that is written ("-r X,Y,W,H",
+    // width 0 for the whole image)
+    int column, line, width, height;
+    // type of the output image ("-f p3|p5|p6") and largest value of its
+    // samples ("-M MAXVAL"); 0 for the ones of the input image ("-m")
+    // or for an 8-bit "P6" image ("-d"). the colours of the quadtree
+    // have 8 bits, so a 16-bit image only gets them widened
+    int format, max_color;
+} options;
 
-    /*
-        determine first argument type and further
-        proceed depending on this information
-    */
+// number of lines rendered at once by a single thread
+#define RENDER_LINES 16
+
+// number of images of a list that are read and compressed together
+#define BATCH_SIZE 1024
+
+/*
+structure of the buffers reused when compressing several images
+*/
+typedef struct Context
+{
+    QTree tree;
+    SumTable table;
+} Context;
+
+/*
+structure of the argument of a task that compresses an image of a list
 
-    // command's first argument is "-c" (image compression)
-    if(strcmp(argv[1], "-c") == 0)
+contexts = the buffers of every worker
+status = 0 if the image was compressed
+*/
+typedef struct BatchJob
+{
+    char *input, *output;
+    int factor;
+    options *opt;
+    Context *contexts;
+    int status;
+} BatchJob;
+
+/*
+function used to separate the options of a command (arguments that start 
+with '-' followed by a letter, or with "--") from its positional arguments
+*/
+int parse_options (int argc, char *argv[], options *opt, char *args[])
+{
+    int i = 0, count = 0;
+
+    opt->bottom_up = 0;
+    opt->tile = 0;
+    opt->threads = 1;
+    opt->threshold = 64;
+    opt->band = 0;
+    opt->compact = 0;
+    opt->progressive = 0;
+    opt->target_size = 0;
+    opt->target_psnr = 0;
+    opt->list = NULL;
+    opt->state = NULL;
+    opt->stats = 0;
+    opt->shift = 0;
+    opt->width = 0;
+    opt->format = 0;
+    opt->max_color = 0;
+
+    for(i = 2; i < argc; i++)
     {
-        // the argv[2] element stores 
-        // the compression factor
-        int factor = 0;
-        factor = atoi(argv[2]);
+        if(argv[i][0] == '-' && (isalpha((unsigned char) argv[i][1]) || 
+                                 argv[i][1] == '-'))
+        {
+            if(strcmp(argv[i], "-b") == 0)
+                opt->bottom_up = 1;
+            else if(strcmp(argv[i], "-z") == 0)
+                opt->compact = 1;
+            else if(strcmp(argv[i], "-p") == 0)
+                opt->progressive = 1;
+            else if(strcmp(argv[i], "--stats") == 0)
+                opt->stats = 1;
+            else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                opt->threads = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+                opt->threshold = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-Z") == 0 && i + 1 < argc)
+                opt->tile = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+                opt->band = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+                opt->target_size = strtoull(argv[++i], NULL, 10);
+            else if(strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+                opt->target_psnr = atof(argv[++i]);
+            else if(strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+                opt->list = argv[++i];
+            else if(strcmp(argv[i], "-I") == 0 && i + 1 < argc)
+                opt->state = argv[++i];
+            else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+                opt->shift = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+                opt->max_color = atoi(argv[++i]);
+            else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            {
+                opt->format = parse_format(argv[++i]);
+                if(opt->format < 0)
+                {
+                    fprintf(stderr, "unknown image type %s\n", argv[i]);
+                    return -1;
+                }
+            }
+            else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            {
+                if(sscanf(argv[++i], "%d,%d,%d,%d", &opt->column, &opt->line,
+                          &opt->width, &opt->height) != 4 || 
+                   opt->width <= 0 || opt->height <= 0)
+                {
+                    fprintf(stderr, "invalid region %s\n", argv[i]);
+                    return -1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "unknown option %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else
+            args[count++] = argv[i];
+    }
 
-        // the following two arguments represent the input file and
-        // the output file names
-        FILE *f = NULL, *g = NULL;
-        f = fopen(argv[3], "rb");
-        g = fopen(argv[4], "wb");
+    // at least one thread and blocks of at least one pixel
+    if(opt->threads < 1)
+        opt->threads = 1;
+    if(opt->threshold < 1)
+        opt->threshold = 1;
+    if(opt->shift < 0)
+        opt->shift = 0;
 
-        // verify if input file is opened
-        if(f != NULL)
+    // the size of a progressive file is not estimated by the rate
+    // controlled construction
+    if(opt->progressive && (opt->compact || opt->band > 0 || 
+                            opt->target_size > 0))
+    {
+        fprintf(stderr, "-p cannot be used with -z, -s or -S\n");
+        return -1;
+    }
+
+    // the samples of the output image have at most 2 bytes
+    if(opt->max_color < 0 || opt->max_color > 65535)
+    {
+        fprintf(stderr, "the largest sample %d is not between 1 and "
+                        "65535\n", opt->max_color);
+        return -1;
+    }
+
+    // the tiled layout is only read by the bottom-up construction
+    if(opt->tile < 0 || (opt->tile & (opt->tile - 1)) != 0 || 
+       opt->tile > (1 << QT_MAX_LEVEL))
+    {
+        fprintf(stderr, "the tile size %d is not a power of two\n", 
+                opt->tile);
+        return -1;
+    }
+    if(opt->tile > 0 && (!opt->bottom_up || opt->band > 0 || 
+                         opt->target_size > 0 || opt->target_psnr > 0 || 
+                         opt->state != NULL))
+    {
+        fprintf(stderr, "-Z needs -b and cannot be used with -s, -S, -P "
+                        "or -I\n");
+        return -1;
+    }
+
+    return count;
+}
+
+/*
+function used to build the pixels matrix of an image based on its .ppm
+file, line by line or in the tiled layout ("-Z")
+*/
+int read_grid (Grid *grid, FILE *f, options *opt)
+{
+    if(opt->tile > 0)
+        return build_grid_t(grid, f, opt->tile);
+
+    return build_grid_c(grid, f);
+}
+
+/*
+function used to build the compression quadtree of an image from the
+tiles of the previous image, which are read from the state file of the
+"-I" option; the file is then replaced by the tiles of the image
+*/
+void build_incremental (QTree *tree, Grid *grid, int factor, options *opt)
+{
+    Tiles old, tiles;
+    FILE *f = fopen(opt->state, "rb");
+
+    init_tiles(&old);
+    init_tiles(&tiles);
+
+    // without a valid state file, all the tiles are built
+    if(f != NULL)
+    {
+        if(load_tiles(&old, f) != 0)
+            fprintf(stderr, "%s is not a valid state file\n", opt->state);
+        fclose(f);
+    }
+
+    // the side length of the tiles is the one of the "-t" option
+    build_QTree_tiles(tree, grid, factor, opt->threshold, &old, &tiles);
+
+    f = fopen(opt->state, "wb");
+    if(f == NULL)
+        fprintf(stderr, "cannot open %s\n", opt->state);
+    else
+    {
+        save_tiles(&tiles, f);
+        fclose(f);
+    }
+
+    free_tiles(&old);
+    free_tiles(&tiles);
+}
+
+/*
+function used to build the compression quadtree of the pixels matrix,
+top-down from its summed-area table or bottom-up from the pixels; the
+memory of the table is reused
+*/
+void build_tree (QTree *tree, SumTable *table, Grid *grid, int factor, options *opt, ThreadPool *pool, Stats *stats)
+{
+    int size = quadtree_size(grid->width, grid->height);
+    int rate = (opt->target_size > 0 || opt->target_psnr > 0);
+    double start = stats_clock(stats);
+
+    if(opt->state != NULL)
+        build_incremental(tree, grid, factor, opt);
+    else if(opt->bottom_up && !rate)
+        build_QTree_b(tree, grid, size, factor);
+    else
+    {
+        // build the summed-area table of the pixels matrix
+        build_sum_table(table, grid);
+        stats_phase(stats, PHASE_TABLE, start);
+        start = stats_clock(stats);
+
+        // build the compression quadtree based on
+        // the summed-area table; the rate controlled construction 
+        // ("-S" and "-P") always uses a single thread
+        if(rate)
         {
-            int width = 0, height = 0, max_color = 0;
-            int k = 0;
-            
-            pixel **grid = NULL;
-            QTree *tree = NULL;
+            Budget budget = {opt->target_size, opt->target_psnr, 
+                             opt->compact};
+            build_QTree_rate(tree, table, size, factor, &budget);
+        }
+        else if(pool != NULL)
+            build_QTree_c_parallel(tree, table, size, factor, 
+                                   opt->threshold, pool);
+        else
+            build_QTree_c(tree, table, 0, 0, size, factor);
+    }
 
-            // initialize the quadtree
-            init_QTree(&tree);
+    stats_phase(stats, PHASE_TREE, start);
+}
 
-            // build the pixels matrix of image
-            build_grid_c(&grid, &width, &height, &max_color, f);
+/*
+function used to write the compressed file of a quadtree, in the legacy
+format, in the compact one ("-z") or in the progressive one ("-p")
+*/
+void write_compressed (QTree *tree, int width, int height, FILE *g, options *opt)
+{
+    if(opt->compact)
+    {
+        // write the range coded quadtree
+        encode_QTree(tree, width, height, g);
+    }
+    else if(opt->progressive)
+    {
+        // write the nodes array in breadth-first order
+        write_levels(tree, width, height, g);
+    }
+    else
+    {
+        // write the number of leaf nodes and the total number 
+        // of nodes in the binary output file
+        fwrite(&tree->leaves, sizeof(uint32_t), 1, g);
+        fwrite(&tree->nodes, sizeof(uint32_t), 1, g);
 
-            // build the compression quadtree based on
-            // the pixels matrix
-            build_QTree_c(tree, grid, 0, 0, width, factor);
-            
-            // calculate total number of nodes and store it in 'nodes'
-            // variable
-            // calculate number of leaf nodes and store it in 'leaves'
-            // variable
-            uint32_t nodes = num_nodes(tree), leaves = num_leaves(tree);
+        // write array in the binary output file
+        fwrite(tree->node_vector, sizeof(QuadtreeNode), tree->nodes, g);
 
-            // write the two values in the binary output file
-            fwrite(&leaves, sizeof(uint32_t), 1, g);
-            fwrite(&nodes, sizeof(uint32_t), 1, g);
+        // write the dimensions of the image, if it is not
+        // a square with a side length that is a power of two
+        write_dimensions(width, height, tree->line, tree->column, g);
+    }
+    fflush(g);
+}
 
-            // allocate the array of quadtree nodes
-            QuadtreeNode *node_vector = NULL;
-            node_vector = (QuadtreeNode*) malloc(nodes * sizeof(QuadtreeNode));
+/*
+function used to initialize the buffers of a compression context
+*/
+void init_context (Context *context)
+{
+    init_QTree(&context->tree);
+    init_sum_table(&context->table);
+}
+
+/*
+function used to free the buffers of a compression context
+*/
+void free_context (Context *context)
+{
+    free_QTree(&context->tree);
+    free_sum_table(&context->table);
+}
 
-            // find value of k, where 2^k = width
-            k = log_two(width);
+/*
+function used to compress an image with the buffers of a context, which
+keep their memory for the next images; returns 0 on success and -1 if
+the image cannot be compressed
+*/
+int compress_file (Context *context, char *input, char *output, int factor, options *opt, ThreadPool *pool)
+{
+    int status = 0, result = 0;
+    double start = 0;
+    FILE *f = NULL, *g = NULL;
+    QTree *tree = &context->tree;
+    Stats stats;
 
-            // index_v = index of the array element that was
-            //           last added
-            int index_v = 0;
+    init_stats(&stats, opt->stats);
 
-            // build array of nodes
-            build_vector(tree, node_vector, k, 0, &index_v);
+    f = fopen(input, "rb");
+    if(f == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", input);
+        return -1;
+    }
 
-            // write array in the binary output file
-            fwrite(node_vector, sizeof(QuadtreeNode), nodes, g);
-            
-            // free array and quadtree
-            free(node_vector);
-            free_QTree(&tree);
+    g = fopen(output, "wb");
+    if(g == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", output);
+        fclose(f);
+        return -1;
+    }
+
+    // compress the image band by band for the "-s" option
+    // (only in the legacy format)
+    if(opt->band > 0)
+    {
+        if(opt->compact)
+        {
+            fprintf(stderr, "-s cannot be used with -z\n");
+            status = -1;
+        }
+        else if(opt->target_size > 0 || opt->target_psnr > 0)
+        {
+            fprintf(stderr, "-s cannot be used with -S or -P\n");
+            status = -1;
+        }
+        else if(opt->state != NULL)
+        {
+            fprintf(stderr, "-s cannot be used with -I\n");
+            status = -1;
+        }
+        else
+        {
+            // all the phases are counted as building the quadtree
+            start = stats_clock(&stats);
+            result = compress_stream(f, g, opt->band, factor);
+            if(result == -1)
+                fprintf(stderr, "%s is not a valid .ppm image\n", input);
+            else if(result != 0)
+                fprintf(stderr, "cannot use the temporary file of %s\n", 
+                        input);
+            if(result != 0)
+                status = -1;
+            stats_phase(&stats, PHASE_TREE, start);
+        }
+    }
+    else
+    {
+        Grid grid;
+
+        // the quadtree starts empty, but keeps its nodes array
+        tree->nodes = 0;
+        tree->leaves = 0;
+
+        // build the pixels matrix of image
+        start = stats_clock(&stats);
+        if(read_grid(&grid, f, opt) != 0)
+        {
+            fprintf(stderr, "%s is not a valid .ppm image\n", input);
+            status = -1;
+        }
+        else
+        {
+            stats_phase(&stats, PHASE_READ, start);
+
+            // build the compression quadtree based on
+            // the pixels matrix; its nodes array is built directly,
+            // together with the number of nodes and leaf nodes
+            build_tree(tree, &context->table, &grid, factor, opt, pool, 
+                       &stats);
+            stats_tree(&stats, tree);
+
+            start = stats_clock(&stats);
+            write_compressed(tree, grid.width, grid.height, g, opt);
+            stats_phase(&stats, PHASE_WRITE, start);
 
             // free pixels matrix
-            for(i = 0; i < height; i++)
-                free(grid[i]);
-            free(grid);
+            free_grid(&grid);
         }
+    }
 
-        // close files
+    if(status == 0)
+    {
+        stats_files(&stats, f, g);
+        print_stats(&stats, "compress", input);
+    }
+
+    // close files
+    fclose(f);
+    fclose(g);
+
+    return status;
+}
+
+/*
+task used to compress an image of a batch, with the context of the
+worker that runs it
+*/
+void batch_task (void *arg)
+{
+    BatchJob *job = (BatchJob *) arg;
+    int id = pool_worker();
+
+    job->status = compress_file(&job->contexts[id < 0 ? 0 : id], 
+                                job->input, job->output, job->factor, 
+                                job->opt, NULL);
+}
+
+/*
+function used to compress the images of a list file, which has an input
+file and an output file on each line (empty lines and lines that start
+with '#' are skipped); returns 0 if all images were compressed
+*/
+int compress_batch (char *list, int factor, options *opt, ThreadPool *pool)
+{
+    /*
+        the images are compressed in groups of BATCH_SIZE; with the "-j"
+        option, every image is a separate task, which builds its quadtree
+        on a single thread, and each worker keeps its own context
+    */
+
+    int i = 0, count = 0, status = 0, done = 0;
+    int contexts = (pool != NULL) ? opt->threads : 1;
+    char line[4096];
+    FILE *f = fopen(list, "r");
+
+    if(f == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", list);
+        return 1;
+    }
+
+    Context *context = (Context *) malloc(contexts * sizeof(Context));
+    for(i = 0; i < contexts; i++)
+        init_context(&context[i]);
+
+    BatchJob *jobs = (BatchJob *) malloc(BATCH_SIZE * sizeof(BatchJob));
+
+    while(!done)
+    {
+        // read the next group of images
+        count = 0;
+        while(count < BATCH_SIZE)
+        {
+            char input[2048], output[2048];
+            int fields = 0;
+
+            if(fgets(line, sizeof(line), f) == NULL)
+            {
+                done = 1;
+                break;
+            }
+
+            fields = sscanf(line, "%2047s %2047s", input, output);
+            if(line[0] == '#' || fields < 1)
+                continue;
+            if(fields != 2)
+            {
+                fprintf(stderr, "invalid line in %s: %s", list, line);
+                status = 1;
+                continue;
+            }
+
+            jobs[count].input = strdup(input);
+            jobs[count].output = strdup(output);
+            jobs[count].factor = factor;
+            jobs[count].opt = opt;
+            jobs[count].contexts = context;
+            jobs[count].status = 0;
+            count++;
+        }
+
+        // compress them
+        for(i = 0; i < count; i++)
+        {
+            if(pool != NULL)
+                pool_submit(pool, batch_task, &jobs[i]);
+            else
+                batch_task(&jobs[i]);
+        }
+        if(pool != NULL)
+            pool_wait(pool);
+
+        for(i = 0; i < count; i++)
+        {
+            if(jobs[i].status != 0)
+                status = 1;
+            free(jobs[i].input);
+            free(jobs[i].output);
+        }
+    }
+
+    for(i = 0; i < contexts; i++)
+        free_context(&context[i]);
+    free(context);
+    free(jobs);
+    fclose(f);
+
+    return status;
+}
+
+/*
+function used to find the view of an image with given dimensions, 
+described by a quadtree, that is selected by the "-l" and "-r" options;
+returns -1 if the rectangle of the "-r" option is outside the image
+*/
+int select_view (View *view, QTree *tree, int width, int height, options *opt)
+{
+    init_view(view, tree, width, height, opt->shift);
+
+    if(opt->width == 0)
+        return 0;
+
+    // keep the part of the rectangle that is inside the reduced image;
+    // the rectangle starts at the top-left pixel of the image
+    int right = opt->column + opt->width, bottom = opt->line + opt->height;
+    int column = (opt->column > 0) ? opt->column : 0;
+    int line = (opt->line > 0) ? opt->line : 0;
+    if(right > view->columns)
+        right = view->columns;
+    if(bottom > view->lines)
+        bottom = view->lines;
+
+    view->width = right - column;
+    view->height = bottom - line;
+    view->column += column;
+    view->line += line;
+    if(view->width <= 0 || view->height <= 0)
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to write a view of the image described by a compression
+quadtree in an 8-bit "P6" file on disk, rendering its pixels directly in
+the memory mapped file; with "-j", the blocks of at most 'threshold' 
+pixels are rendered at the same time by different threads; returns -1 
+if the file cannot be mapped (for example, a pipe), its space cannot be
+reserved or it has another type, and -2 if the mapped pixels cannot be 
+written back
+*/
+int map_tree (QTree *tree, View *view, FILE *g, options *opt, ThreadPool *pool, Stats *stats)
+{
+    char header[50];
+    int count = 0;
+    size_t length = 0;
+    double start = 0;
+    struct stat info;
+    void *map = MAP_FAILED;
+
+    if((opt->format > 0 && opt->format != PPM_RGB) || 
+       (opt->max_color > 0 && opt->max_color != 255))
+        return -1;
+
+    count = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", 
+                     view->width, view->height);
+    length = count + (size_t) view->width * view->height * sizeof(pixel);
+
+    // the blocks of the file are reserved before it is mapped, so a full
+    // disk is found here and not by a signal while the pixels are written
+    if(fstat(fileno(g), &info) != 0 || !S_ISREG(info.st_mode))
+        return -1;
+    if(posix_fallocate(fileno(g), 0, length) != 0)
+    {
+        ftruncate(fileno(g), 0);
+        return -1;
+    }
+    map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, 
+               fileno(g), 0);
+    if(map == MAP_FAILED)
+    {
+        ftruncate(fileno(g), 0);
+        return -1;
+    }
+
+    memcpy(map, header, count);
+
+    start = stats_clock(stats);
+    if(pool != NULL)
+        render_view_parallel(tree, view, (pixel *) ((char *) map + count), 
+                             opt->threshold, pool);
+    else
+        render_lines(tree, view, view->line, view->height, 
+                     (pixel *) ((char *) map + count));
+    stats_phase(stats, PHASE_RENDER, start);
+
+    // the pages of the mapping are written back before it is removed, 
+    // so the errors of the writes are reported
+    start = stats_clock(stats);
+    if(msync(map, length, MS_SYNC) != 0)
+    {
+        perror("msync");
+        munmap(map, length);
+        return -2;
+    }
+    if(munmap(map, length) != 0)
+    {
+        perror("munmap");
+        return -2;
+    }
+    stats_phase(stats, PHASE_WRITE, start);
+
+    return 0;
+}
+
+/*
+function used to write a view of the image described by a compression 
+quadtree in a .ppm file (of the type of the "-f" and "-M" options), 
+without building its pixels matrix; returns 0 on success and -1 if the 
+pixels cannot be written (for example, on a full disk)
+*/
+int write_tree (QTree *tree, View *view, FILE *g, options *opt, ThreadPool *pool, Stats *stats)
+{
+    int i = 0, result = 0;
+    double start = 0;
+
+    // an 8-bit "P6" file on disk is rendered in place, and the other
+    // files (or a file that cannot be reserved) are written in buffers
+    result = map_tree(tree, view, g, opt, pool, stats);
+    if(result != -1)
+        return (result == 0) ? 0 : -1;
+
+    // the lines are rendered in groups of 'count' lines, which are
+    // shared between the threads in bands of 'threshold' lines
+    int count = RENDER_LINES;
+    if(pool != NULL)
+        count = opt->threads * opt->threshold;
+    if(count > view->height)
+        count = view->height;
+
+    // write header in output file; the pixels of an 8-bit "P6"
+    // file are written directly from the lines buffer
+    PpmWriter writer;
+    open_writer(&writer, g, (opt->format > 0) ? opt->format : PPM_RGB,
+                (opt->max_color > 0) ? opt->max_color : 255, view->width, 
+                view->height);
+
+    // render the lines in a buffer that is reused, then write them
+    pixel *lines = (pixel *) malloc((size_t) count * view->width * 
+                                    sizeof(pixel));
+    for(i = 0; i < view->height; i = i + count)
+    {
+        int rows = (view->height - i < count) ? view->height - i : count;
+
+        start = stats_clock(stats);
+        if(pool != NULL)
+            render_lines_parallel(tree, view, view->line + i, rows, lines, 
+                                  opt->threshold, pool);
+        else
+            render_lines(tree, view, view->line + i, rows, lines);
+        stats_phase(stats, PHASE_RENDER, start);
+
+        start = stats_clock(stats);
+        write_pixels(&writer, lines, (size_t) rows * view->width);
+        stats_phase(stats, PHASE_WRITE, start);
+    }
+    start = stats_clock(stats);
+    close_writer(&writer);
+    stats_phase(stats, PHASE_WRITE, start);
+
+    // free the lines buffer
+    free(lines);
+
+    return ferror(g) ? -1 : 0;
+}
+
+/*
+function used to find the transform of the "-x" argument from its name;
+returns -1 if the name is not known
+*/
+int parse_transform (char *type)
+{
+    static const char *name[TRANSFORMS] = {"v", "h", "t", "90", "180", "270"};
+    int i = 0;
+
+    for(i = 0; i < TRANSFORMS; i++)
+        if(strcmp(type, name[i]) == 0)
+            return i;
+
+    return -1;
+}
+
+/*
+function used to transform the image of a compressed file and write the
+compressed file of the result, without rendering its pixels; returns 0 
+on success and -1 on error
+*/
+int transform_file (char *type, char *input, char *output, options *opt)
+{
+    int code = parse_transform(type);
+    int width = 0, height = 0;
+    double start = 0;
+    FILE *f = NULL, *g = NULL;
+    QTree tree;
+    Stats stats;
+
+    if(code < 0)
+    {
+        fprintf(stderr, "unknown transform %s\n", type);
+        return -1;
+    }
+
+    f = fopen(input, "rb");
+    if(f == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", input);
+        return -1;
+    }
+
+    init_QTree(&tree);
+    init_stats(&stats, opt->stats);
+
+    // read the quadtree, in the legacy or the compact format
+    start = stats_clock(&stats);
+    if(load_QTree(&tree, f, &width, &height) != 0)
+    {
+        fprintf(stderr, "%s is not a valid compressed file\n", input);
+        free_QTree(&tree);
         fclose(f);
-        fclose(g);
+        return -1;
     }
+    stats_phase(&stats, PHASE_LOAD, start);
 
-    // command's first argument is "-d" (image decompression)
-    if(strcmp(argv[1], "-d") == 0)
+    start = stats_clock(&stats);
+    transform_image(&tree, code, &width, &height);
+    stats_phase(&stats, PHASE_FLIP, start);
+    stats_tree(&stats, &tree);
+
+    g = fopen(output, "wb");
+    if(g == NULL)
     {
-        // the following two arguments represent the input file and
-        // the output file names
-        FILE *f = NULL, *g = NULL;
-        f = fopen(argv[2], "rb");
-        g = fopen(argv[3], "wb");
+        fprintf(stderr, "cannot open %s\n", output);
+        free_QTree(&tree);
+        fclose(f);
+        return -1;
+    }
 
-        // verify if input file is opened
-        if(f != NULL)
-        {   
-            pixel **grid = NULL;
-            QTree *tree = NULL;
+    start = stats_clock(&stats);
+    write_compressed(&tree, width, height, g, opt);
+    stats_phase(&stats, PHASE_WRITE, start);
 
-            // read values of 'nodes' and 'leaves' variables from
-            // input file
-            uint32_t nodes = 0, leaves = 0;
-            fread(&leaves, sizeof(uint32_t), 1, f);
-            fread(&nodes, sizeof(uint32_t), 1, f);
+    stats_files(&stats, f, g);
+    print_stats(&stats, "transform", input);
 
-            // allocate nodes array
-            QuadtreeNode *node_vector = NULL;
-            node_vector = (QuadtreeNode*) malloc(nodes * sizeof(QuadtreeNode));
+    free_QTree(&tree);
+    fclose(f);
+    fclose(g);
 
-            // read array from input file
-            fread(node_vector, sizeof(QuadtreeNode), nodes, f);
+    return 0;
+}
 
-            // initialize quadtree
-            init_QTree(&tree);
+/*
+function used to answer the queries of the standard input about the 
+colours of a compressed file, one on each line: "X Y" for the pixel at 
+column X and line Y, or "X Y W H" for the mean colours of a rectangle; 
+every answer is a line "R G B" on the standard output, or "-" if the
+pixel or the rectangle is outside the image; returns 0 on success and -1
+on error
+*/
+int query_file (char *input, options *opt)
+{
+    int x = 0, y = 0, w = 0, h = 0, count = 0;
+    double start = 0;
+    char line[256];
+    FILE *f = NULL;
+    Index index;
+    pixel colour;
+    Stats stats;
 
-            // build quadtree based on nodes array
-            build_QTree_d(tree, node_vector, 0);
+    f = fopen(input, "rb");
+    if(f == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", input);
+        return -1;
+    }
 
-            unsigned long long total_area = 0;
+    init_stats(&stats, opt->stats);
 
-            // calculate area of image
-            for(i = 0; i < nodes; i++)
-                if(node_vector[i].top_left == -1)
-                    total_area = total_area + node_vector[i].area;
+    // only the header of the file is read; the nodes are read
+    // when a query reaches them
+    start = stats_clock(&stats);
+    if(open_index(&index, f) != 0)
+    {
+        fprintf(stderr, "%s is not a valid compressed file\n", input);
+        fclose(f);
+        return -1;
+    }
+    stats_phase(&stats, PHASE_LOAD, start);
 
-            // calculate image dimensions
-            int height = sqrt(total_area);
-            int width = height;
+    start = stats_clock(&stats);
+    while(fgets(line, sizeof(line), stdin) != NULL)
+    {
+        count = sscanf(line, "%d %d %d %d", &x, &y, &w, &h);
+        if(count == 2 && x >= 0 && x < index.width && 
+           y >= 0 && y < index.height)
+        {
+            query_point(&index, y, x, &colour);
+            printf("%d %d %d\n", colour.red, colour.green, colour.blue);
+        }
+        else if(count == 4 && w > 0 && h > 0 && 
+                query_rect(&index, y, x, h, w, &colour) > 0)
+            printf("%d %d %d\n", colour.red, colour.green, colour.blue);
+        else if(count == 2 || count == 4)
+            printf("-\n");
+        else if(count > 0)
+            fprintf(stderr, "invalid query %s", line);
+    }
+    fflush(stdout);
+    stats_phase(&stats, PHASE_RENDER, start);
 
-            // allocate pixels matrix
-            grid = (pixel **) malloc(height * sizeof(pixel*));
-            for(i = 0; i < height; i++)
-                grid[i] = (pixel *) malloc(width * sizeof(pixel));
+    stats_files(&stats, f, stdout);
+    print_stats(&stats, "query", input);
 
-            // build pixels matrix based on quadtree
-            build_grid_d(tree, grid, 0, 0, width);
+    close_index(&index);
+    fclose(f);
 
-            // allocate 'cuv' array, which stores the header for the
-            // .ppm output file
-            char *cuv = malloc(50 * sizeof(char));
-            sprintf(cuv, "P6\n%d %d\n255\n", width, height);
+    return 0;
+}
 
-            // write header in output file
-            fwrite(cuv, sizeof(char), strlen(cuv), g);
+int main(int argc, char *argv[])
+{
+    int status = 0;
 
-            // write pixels matrix in output file
-            for(i = 0; i < height; i++)
-                fwrite(grid[i], sizeof(pixel), width, g);
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s -c|-d|-m|-x|-q [options] arguments\n", 
+                argv[0]);
+        return 1;
+    }
 
-            // free nodes array and quadtree
-            free(node_vector);
-            free_QTree(&tree);
+    // args = positional arguments that follow the operation type
+    options opt;
+    char **args = (char **) malloc(argc * sizeof(char *));
+    int num_args = parse_options(argc, argv, &opt, args);
 
-            // free pixels matrix
-            for(i = 0; i < height; i++)
-                free(grid[i]);
-            free(grid);
+    if(num_args < 0)
+    {
+        free(args);
+        return 1;
+    }
+
+    // start worker threads for the "-j" option
+    ThreadPool *pool = NULL;
+    if(opt.threads > 1)
+        pool = pool_create(opt.threads);
+
+    /*
+        determine first argument type and further
+        proceed depending on this information
+    */
 
-            // free 'cuv' array
-            free(cuv);
+    // command's first argument is "-c" (image compression); the
+    // factor is followed by the input and the output files, unless 
+    // the images are given by a list ("-L")
+    if(strcmp(argv[1], "-c") == 0 && 
+       num_args < ((opt.list != NULL) ? 1 : 3))
+    {
+        fprintf(stderr, "usage: %s -c [options] factor input output\n"
+                "       %s -c -L list [options] factor\n", argv[0], argv[0]);
+        status = 1;
+    }
+    else if(strcmp(argv[1], "-c") == 0)
+    {
+        // the args[0] element stores 
+        // the compression factor
+        int factor = 0;
+        factor = atoi(args[0]);
+
+        if(opt.state != NULL && (opt.list != NULL || opt.target_size > 0 ||
+                                 opt.target_psnr > 0))
+        {
+            fprintf(stderr, "-I cannot be used with -L, -S or -P\n");
+            status = 1;
+        }
+        else if(opt.list != NULL)
+        {
+            // compress every image of the list ("-L")
+            status = compress_batch(opt.list, factor, &opt, pool);
+        }
+        else
+        {
+            // the following two arguments represent the input file 
+            // and the output file names
+            Context context;
+            init_context(&context);
+            status = compress_file(&context, args[1], args[2], factor, 
+                                   &opt, pool);
+            free_context(&context);
+        }
+    }
+
+    // command's first argument is "-d" (image decompression)
+    if(strcmp(argv[1], "-d") == 0 && num_args < 2)
+    {
+        fprintf(stderr, "usage: %s -d [options] input output\n", argv[0]);
+        status = 1;
+    }
+    else if(strcmp(argv[1], "-d") == 0)
+    {
+        // the following two arguments represent the input file and
+        // the output file names
+        FILE *f = NULL, *g = NULL;
+        f = fopen(args[0], "rb");
+        // the output file is also opened for reading, so it can be
+        // mapped in memory by "write_tree"
+        g = fopen(args[1], "w+b");
+        if(g == NULL)
+            g = fopen(args[1], "wb");
+        if(f == NULL || g == NULL)
+        {
+            fprintf(stderr, "cannot open %s\n", f == NULL ? args[0] : args[1]);
+            return 1;
+        }
+
+        // verify if input file is opened
+        if(f != NULL)
+        {   
+            QTree tree;
+            Stats stats;
+
+            // initialize quadtree
+            init_QTree(&tree);
+            init_stats(&stats, opt.stats);
+
+            // read the quadtree from input file, in the legacy or
+            // the compact format; the nodes array is used directly
+            int width = 0, height = 0;
+            double start = stats_clock(&stats);
+            if(load_QTree(&tree, f, &width, &height) != 0)
+            {
+                fprintf(stderr, "%s is not a valid compressed file\n", args[0]);
+                return 1;
+            }
+            stats_phase(&stats, PHASE_LOAD, start);
+            stats_tree(&stats, &tree);
+
+            // select the part of the image and the resolution
+            // of the output file
+            View view;
+            if(select_view(&view, &tree, width, height, &opt) != 0)
+            {
+                fprintf(stderr, "the region is outside the image\n");
+                return 1;
+            }
+
+            // write .ppm output file, rendering its lines
+            // directly from the quadtree
+            if(write_tree(&tree, &view, g, &opt, pool, &stats) != 0)
+            {
+                fprintf(stderr, "cannot write %s\n", args[1]);
+                return 1;
+            }
+            stats_files(&stats, f, g);
+            print_stats(&stats, "decompress", args[0]);
+
+            // free quadtree
+            free_QTree(&tree);
         }
         
         // close files
@@ -173,66 +1046,111 @@ int main(int argc, char *argv[])
     }
 
     // command's first argument is "-m" (image flip)
-    if(strcmp(argv[1], "-m") == 0)
+    if(strcmp(argv[1], "-m") == 0 && num_args < 4)
+    {
+        fprintf(stderr, "usage: %s -m v|h [options] factor input output\n",
+                argv[0]);
+        status = 1;
+    }
+    else if(strcmp(argv[1], "-m") == 0)
     {
-        // argv[2][0] element represents the flip type 
+        // args[0][0] element represents the flip type 
         char type = '\0';
-        type = argv[2][0];
+        type = args[0][0];
 
-        // argv[3] represents the next argument, compression factor
-        int factor = atoi(argv[3]);
+        // args[1] represents the next argument, compression factor
+        int factor = atoi(args[1]);
 
         // the following two arguments represent the input file and
         // the output file names
         FILE *f = NULL, *g = NULL;
-        f = fopen(argv[4], "rb");
-        g = fopen(argv[5], "wb");
+        f = fopen(args[2], "rb");
+        // the output file is also opened for reading, so it can be
+        // mapped in memory by "write_tree"
+        g = fopen(args[3], "w+b");
+        if(g == NULL)
+            g = fopen(args[3], "wb");
+        if(f == NULL || g == NULL)
+        {
+            fprintf(stderr, "cannot open %s\n", f == NULL ? args[2] : args[3]);
+            return 1;
+        }
 
         // verify if input file is opened
         if(f != NULL)
         {
-            int width = 0, height = 0, max_color = 0;
-            pixel **grid = NULL;
-            QTree *tree = NULL;
+            Grid grid;
+            QTree tree;
+            Stats stats;
 
             // initialize compression quadtree
             init_QTree(&tree);
+            init_stats(&stats, opt.stats);
 
             // build initial pixels matrix
-            build_grid_c(&grid, &width, &height, &max_color, f);
+            double start = stats_clock(&stats);
+            if(read_grid(&grid, f, &opt) != 0)
+            {
+                fprintf(stderr, "%s is not a valid .ppm image\n", args[2]);
+                return 1;
+            }
+            stats_phase(&stats, PHASE_READ, start);
 
             // build compression quadtree based on
             // initial pixels matrix
-            build_QTree_c(tree, grid, 0, 0, width, factor);
+            SumTable table;
+            init_sum_table(&table);
+            build_tree(&tree, &table, &grid, factor, &opt, pool, &stats);
+            free_sum_table(&table);
+            stats_tree(&stats, &tree);
 
-            // modify quadtree to flip the image
+            // modify quadtree to flip the image; an image that does
+            // not fill the square of its quadtree is moved to the other
+            // side of the square by the flip
+            start = stats_clock(&stats);
+            int size = quadtree_size(grid.width, grid.height);
             if(type == 'v')
-                flip_vertical(tree);
+            {
+                flip_vertical(&tree);
+                tree.line = size - tree.line - grid.height;
+            }
             else
-                flip_horizontal(tree);
+            {
+                flip_horizontal(&tree);
+                tree.column = size - tree.column - grid.width;
+            }
+            stats_phase(&stats, PHASE_FLIP, start);
             
-            // modify pixels matrix based on modified quadtree
-            build_grid_d(tree, grid, 0, 0, width);
+            // the flipped image has the type of the initial one,
+            // unless the "-f" and "-M" options give another one
+            if(opt.format == 0)
+                opt.format = grid.format;
+            if(opt.max_color == 0)
+                opt.max_color = grid.max_color;
+
+            // the initial pixels matrix is no longer needed
+            View view;
+            int outside = select_view(&view, &tree, grid.width, grid.height, 
+                                      &opt);
+            free_grid(&grid);
 
-            // write header in .ppm output file
-            char *cuv = malloc(50 * sizeof(char));
-            sprintf(cuv, "P6\n%d %d\n255\n", width, height);
-            fwrite(cuv, sizeof(char), strlen(cuv), g);
+            if(outside != 0)
+            {
+                fprintf(stderr, "the region is outside the image\n");
+                return 1;
+            }
 
-            // write pixels matrix in .ppm output file
-            for(i = 0; i < height; i++)
-                fwrite(grid[i], sizeof(pixel), width, g);
+            // write .ppm output file based on modified quadtree
+            if(write_tree(&tree, &view, g, &opt, pool, &stats) != 0)
+            {
+                fprintf(stderr, "cannot write %s\n", args[3]);
+                return 1;
+            }
+            stats_files(&stats, f, g);
+            print_stats(&stats, "flip", args[2]);
 
             // free quadtree
             free_QTree(&tree);
-
-            // free pixels matrix
-            for(i = 0; i < height; i++)
-                free(grid[i]);
-            free(grid);
-
-            // free 'cuv' array
-            free(cuv);
         }
 
         // close files
@@ -240,5 +1158,39 @@ int main(int argc, char *argv[])
         fclose(g);
     }
 
-    return 0;
+    // command's first argument is "-x" (transform of a compressed file)
+    if(strcmp(argv[1], "-x") == 0)
+    {
+        // the following three arguments represent the transform, 
+        // the input file and the output file names
+        if(num_args < 3)
+        {
+            fprintf(stderr, "usage: %s -x v|h|t|90|180|270 [options] "
+                    "input output\n", argv[0]);
+            status = 1;
+        }
+        else
+            status = transform_file(args[0], args[1], args[2], &opt);
+    }
+
+    // command's first argument is "-q" (queries of the colours of a
+    // compressed file)
+    if(strcmp(argv[1], "-q") == 0)
+    {
+        // the following argument represents the input file name; the
+        // queries are read from the standard input
+        if(num_args < 1)
+        {
+            fprintf(stderr, "usage: %s -q [options] input\n", argv[0]);
+            status = 1;
+        }
+        else
+            status = query_file(args[0], &opt);
+    }
+
+    if(pool != NULL)
+        pool_destroy(pool);
+    free(args);
+
+    return (status != 0) ? 1 : 0;
 }
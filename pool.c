@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "pool.h"
+
+// index of the calling worker and the pool it belongs to
+static __thread int worker_id = -1;
+static __thread ThreadPool *worker_pool = NULL;
+
+/*
+structure of the argument of a worker thread
+*/
+typedef struct WorkerArg
+{
+    ThreadPool *pool;
+    int id;
+} WorkerArg;
+
+/*
+function used to add a task at the bottom of a deque of a pool and wake
+a worker; the task is counted in 'queued' before the deque is unlocked,
+so a worker cannot take it before it is counted, and never finds more
+queued tasks than the ones stored in the deques
+*/
+static void deque_push (ThreadPool *pool, Deque *deque, Task task)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&deque->lock);
+
+    // double the capacity of the circular array when it is full
+    if(deque->bottom - deque->top == deque->capacity)
+    {
+        Task *tasks = (Task *) malloc(2 * deque->capacity * sizeof(Task));
+        for(i = deque->top; i < deque->bottom; i++)
+            tasks[i % (2 * deque->capacity)] =
+                deque->tasks[i % deque->capacity];
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = 2 * deque->capacity;
+    }
+
+    deque->tasks[deque->bottom % deque->capacity] = task;
+    deque->bottom++;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/*
+function used to remove a task from a deque, from its bottom (for the owner)
+or from its top (for the other workers); returns 0 if the deque is empty
+*/
+static int deque_pop (Deque *deque, Task *task, int steal)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if(deque->bottom > deque->top)
+    {
+        if(steal)
+        {
+            (*task) = deque->tasks[deque->top % deque->capacity];
+            deque->top++;
+        }
+        else
+        {
+            deque->bottom--;
+            (*task) = deque->tasks[deque->bottom % deque->capacity];
+        }
+        found = 1;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+/*
+function used by a worker to find a task, first in its own deque and
+then by stealing from the other workers
+*/
+static int take_task (ThreadPool *pool, int id, Task *task)
+{
+    int i = 0;
+
+    if(deque_pop(&pool->deques[id], task, 0) == 0)
+    {
+        for(i = 1; i < pool->threads; i++)
+            if(deque_pop(&pool->deques[(id + i) % pool->threads], task, 1))
+                break;
+
+        if(i == pool->threads)
+            return 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued--;
+    pthread_mutex_unlock(&pool->lock);
+
+    return 1;
+}
+
+/*
+function executed by each worker thread
+*/
+static void *worker_loop (void *arg)
+{
+    ThreadPool *pool = ((WorkerArg *) arg)->pool;
+    int id = ((WorkerArg *) arg)->id;
+    Task task = {NULL, NULL};
+
+    free(arg);
+    worker_id = id;
+    worker_pool = pool;
+
+    while(1)
+    {
+        if(take_task(pool, id, &task))
+        {
+            task.fn(task.arg);
+
+            // signal the waiting thread when the last task finishes
+            pthread_mutex_lock(&pool->lock);
+            pool->pending--;
+            if(pool->pending == 0)
+                pthread_cond_broadcast(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        // sleep until new tasks are submitted
+        pthread_mutex_lock(&pool->lock);
+        while(pool->queued == 0 && !pool->stop)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if(pool->queued == 0 && pool->stop)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/*
+function used to create a thread pool with a given number of workers
+*/
+ThreadPool *pool_create (int threads)
+{
+    int i = 0;
+    ThreadPool *pool = (ThreadPool *) malloc(sizeof(ThreadPool));
+
+    pool->threads = threads;
+    pool->pending = 0;
+    pool->queued = 0;
+    pool->stop = 0;
+    pool->next = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // allocate one deque per worker
+    pool->deques = (Deque *) malloc(threads * sizeof(Deque));
+    for(i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].capacity = 64;
+        pool->deques[i].tasks = (Task *) malloc(64 * sizeof(Task));
+        pool->deques[i].top = 0;
+        pool->deques[i].bottom = 0;
+    }
+
+    // start workers
+    pool->workers = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for(i = 0; i < threads; i++)
+    {
+        WorkerArg *arg = (WorkerArg *) malloc(sizeof(WorkerArg));
+        arg->pool = pool;
+        arg->id = i;
+        pthread_create(&pool->workers[i], NULL, worker_loop, arg);
+    }
+
+    return pool;
+}
+
+/*
+function used to submit a task; a task submitted by a worker goes to its
+own deque, otherwise the deques are chosen in turn
+*/
+void pool_submit (ThreadPool *pool, task_fn fn, void *arg)
+{
+    Task task;
+    int id = 0;
+
+    task.fn = fn;
+    task.arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    if(worker_pool == pool)
+        id = worker_id;
+    else
+    {
+        id = pool->next;
+        pool->next = (pool->next + 1) % pool->threads;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    deque_push(pool, &pool->deques[id], task);
+}
+
+/*
+function used to wait until all submitted tasks (including the ones
+submitted by other tasks) have finished
+*/
+void pool_wait (ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while(pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+function used to stop the workers and free a thread pool
+*/
+void pool_destroy (ThreadPool *pool)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->threads; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    for(i = 0; i < pool->threads; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    free(pool->workers);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool);
+}
+
+/*
+function used to find the index of the calling worker (-1 if the caller
+is not a worker thread)
+*/
+int pool_worker (void)
+{
+    return worker_id;
+}
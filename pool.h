@@ -0,0 +1,56 @@
+#ifndef POOL_H
+#define POOL_H
+#include <pthread.h>
+
+/*
+function executed by a task of the thread pool
+*/
+typedef void (*task_fn) (void *arg);
+
+/*
+structure of task
+*/
+typedef struct Task
+{
+    task_fn fn;
+    void *arg;
+} Task;
+
+/*
+structure of double-ended queue of tasks owned by a worker
+
+the owner pushes and pops tasks at the bottom (last in, first out), while
+idle workers steal the oldest tasks from the top
+*/
+typedef struct Deque
+{
+    pthread_mutex_t lock;
+    Task *tasks;
+    int top, bottom, capacity;
+} Deque;
+
+/*
+structure of work-stealing thread pool
+
+pending = number of submitted tasks that did not finish yet
+queued = number of tasks waiting in the deques
+*/
+typedef struct ThreadPool
+{
+    int threads;
+    pthread_t *workers;
+    Deque *deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    int pending, queued, stop;
+    int next;
+} ThreadPool;
+
+ThreadPool *pool_create (int threads);
+void pool_submit (ThreadPool *pool, task_fn fn, void *arg);
+void pool_wait (ThreadPool *pool);
+void pool_destroy (ThreadPool *pool);
+int pool_worker (void);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ppm.h"
+
+/*
+function used to find the type of a netpbm file from its name ("p3", 
+"p5" or "p6"); returns -1 if the name is not known
+*/
+int parse_format (char *name)
+{
+    if(strcmp(name, "p3") == 0 || strcmp(name, "P3") == 0)
+        return PPM_ASCII;
+    if(strcmp(name, "p5") == 0 || strcmp(name, "P5") == 0)
+        return PPM_GRAY;
+    if(strcmp(name, "p6") == 0 || strcmp(name, "P6") == 0)
+        return PPM_RGB;
+
+    return -1;
+}
+
+/*
+function used to read a number from the header of a .ppm file, skipping
+the whitespace and comments before it, together with the whitespace
+character that follows it; returns -1 if there is no number
+*/
+static int header_number (FILE *f)
+{
+    int c = getc(f), value = 0;
+
+    // skip whitespace and comments (from '#' to the end of the line)
+    while(c != EOF && (isspace(c) || c == '#'))
+    {
+        if(c == '#')
+            while(c != EOF && c != '\n')
+                c = getc(f);
+        else
+            c = getc(f);
+    }
+
+    if(c == EOF || !isdigit(c))
+        return -1;
+
+    // convert characters to number
+    while(c != EOF && isdigit(c))
+    {
+        if(value > 100000000)
+            return -1;
+        value = value * 10 + (c - '0');
+        c = getc(f);
+    }
+
+    return value;
+}
+
+/*
+function used to read the header of a .ppm file ("P3", "P5" or "P6", 
+width, height, max_color and a single whitespace character before the 
+pixels); returns 0 on success and -1 if the header is not valid
+*/
+int read_header (Grid *grid, FILE *f)
+{
+    int c = 0;
+
+    if(getc(f) != 'P')
+        return -1;
+
+    c = getc(f);
+    if(c != '0' + PPM_ASCII && c != '0' + PPM_GRAY && c != '0' + PPM_RGB)
+        return -1;
+
+    grid->format = c - '0';
+    grid->width = header_number(f);
+    grid->height = header_number(f);
+    grid->max_color = header_number(f);
+
+    // the quadtree covers at most 2^QT_MAX_LEVEL * 2^QT_MAX_LEVEL pixels
+    if(grid->width <= 0 || grid->height <= 0 || grid->max_color <= 0 ||
+       grid->max_color > 65535 || grid->width > (1 << QT_MAX_LEVEL) ||
+       grid->height > (1 << QT_MAX_LEVEL))
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to find if the samples of a .ppm file are stored exactly
+like the pixels matrix ("P6" with samples of 1 byte, up to 255)
+*/
+int raw_pixels (Grid *grid)
+{
+    return grid->format == PPM_RGB && grid->max_color == 255;
+}
+
+/*
+function used to read the next 'count' pixels of a .ppm file, whose 
+header was read by read_header; the samples are converted to 8 bits 
+(0 to 255) as they are read, and the grey levels of a "P5" file become
+pixels with three equal colours, so the extra precision of a 16-bit 
+file is not kept; returns 0 on success and -1 if the file ends early or
+a sample is larger than max_color
+*/
+int read_pixels (Grid *grid, FILE *f, pixel *pixels, size_t count)
+{
+    /*
+        the samples of the binary files are read in chunks of at most
+        PPM_BUFFER bytes and converted with a table that has an entry
+        for every value up to max_color
+    */
+
+    int max = grid->max_color, value = 0, k = 0;
+    int channels = (grid->format == PPM_GRAY) ? 1 : 3;
+    int bytes = (max > 255) ? 2 : 1;
+    size_t i = 0, n = 0, chunk = PPM_BUFFER / (channels * bytes);
+    unsigned char *scale = NULL, *buffer = NULL, *s = NULL, sample[3];
+
+    if(raw_pixels(grid))
+        return (fread(pixels, sizeof(pixel), count, f) == count) ? 0 : -1;
+
+    scale = (unsigned char *) malloc(max + 1);
+    for(value = 0; value <= max; value++)
+        scale[value] = ((unsigned long) value * 255 + max / 2) / max;
+
+    if(grid->format != PPM_ASCII)
+        buffer = (unsigned char *) malloc(chunk * channels * bytes);
+
+    while(count > 0)
+    {
+        n = (count < chunk) ? count : chunk;
+        if(buffer != NULL && 
+           fread(buffer, channels * bytes, n, f) != n)
+            break;
+
+        s = buffer;
+        for(i = 0; i < n; i++)
+        {
+            for(k = 0; k < channels; k++)
+            {
+                if(buffer == NULL)
+                    value = header_number(f);
+                else
+                {
+                    value = (bytes == 2) ? (s[0] << 8) | s[1] : s[0];
+                    s = s + bytes;
+                }
+
+                if(value < 0 || value > max)
+                    break;
+                sample[k] = scale[value];
+            }
+            if(k < channels)
+                break;
+
+            pixels[i].red = sample[0];
+            pixels[i].green = sample[channels == 3 ? 1 : 0];
+            pixels[i].blue = sample[channels == 3 ? 2 : 0];
+        }
+        if(i < n)
+            break;
+
+        pixels = pixels + n;
+        count = count - n;
+    }
+
+    free(scale);
+    free(buffer);
+
+    return (count == 0) ? 0 : -1;
+}
+
+/*
+function used to write the buffer of a writer in its file
+*/
+static void flush_writer (PpmWriter *writer)
+{
+    fwrite(writer->buffer, 1, writer->length, writer->g);
+    writer->length = 0;
+}
+
+/*
+function used to add a sample of 8 bits to the buffer of a writer, 
+converted to the maximum value of the samples of its file; a larger
+maximum value only widens the sample, which keeps its 256 levels
+*/
+static void put_sample (PpmWriter *writer, int value)
+{
+    char digits[8];
+    int count = 0;
+
+    if(writer->max_color != 255)
+        value = (value * writer->max_color + 127) / 255;
+
+    if(writer->format == PPM_ASCII)
+    {
+        // decimal digits, in reverse order, then a space
+        do
+        {
+            digits[count++] = '0' + value % 10;
+            value = value / 10;
+        } while(value > 0);
+
+        while(count > 0)
+            writer->buffer[writer->length++] = digits[--count];
+        writer->buffer[writer->length++] = ' ';
+    }
+    else if(writer->max_color > 255)
+    {
+        writer->buffer[writer->length++] = value >> 8;
+        writer->buffer[writer->length++] = value & 0xff;
+    }
+    else
+        writer->buffer[writer->length++] = value;
+}
+
+/*
+function used to start writing an image in a netpbm file of a given 
+type, with samples up to max_color (255 for 1 byte, up to 65535 for 2
+bytes), writing its header
+*/
+void open_writer (PpmWriter *writer, FILE *g, int format, int max_color, int width, int height)
+{
+    writer->g = g;
+    writer->format = format;
+    writer->max_color = max_color;
+    writer->buffer = NULL;
+    writer->length = 0;
+
+    fprintf(g, "P%d\n%d %d\n%d\n", format, width, height, max_color);
+
+    if(format != PPM_RGB || max_color != 255)
+        writer->buffer = (unsigned char *) malloc(PPM_BUFFER);
+}
+
+/*
+function used to write the next 'count' pixels of an image; a grey level
+(for "P5") is the common value of the colours of a pixel, or their 
+luma if they are not equal
+*/
+void write_pixels (PpmWriter *writer, const pixel *pixels, size_t count)
+{
+    size_t i = 0;
+
+    if(writer->buffer == NULL)
+    {
+        fwrite(pixels, sizeof(pixel), count, writer->g);
+        return;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        // room for the longest pixel ("65535 65535 65535 ")
+        if(writer->length + 18 > PPM_BUFFER)
+            flush_writer(writer);
+
+        if(writer->format == PPM_GRAY)
+        {
+            if(pixels[i].red == pixels[i].green && 
+               pixels[i].red == pixels[i].blue)
+                put_sample(writer, pixels[i].red);
+            else
+                put_sample(writer, (299 * pixels[i].red + 
+                                    587 * pixels[i].green + 
+                                    114 * pixels[i].blue + 500) / 1000);
+        }
+        else
+        {
+            put_sample(writer, pixels[i].red);
+            put_sample(writer, pixels[i].green);
+            put_sample(writer, pixels[i].blue);
+        }
+
+        // a "P3" file has a pixel on each line
+        if(writer->format == PPM_ASCII)
+            writer->buffer[writer->length - 1] = '\n';
+    }
+}
+
+/*
+function used to finish writing an image, writing the samples that are
+still in the buffer of a writer
+*/
+void close_writer (PpmWriter *writer)
+{
+    if(writer->buffer != NULL)
+        flush_writer(writer);
+    fflush(writer->g);
+
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
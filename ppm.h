@@ -0,0 +1,44 @@
+#ifndef PPM_H
+#define PPM_H
+#include "header.h"
+
+/*
+types of the netpbm images that are read and written: "P3" (colours as
+decimal numbers), "P5" (grey levels) and "P6" (colours); the samples have
+1 byte, or 2 bytes (most significant first) if the maximum value of a 
+sample is larger than 255
+*/
+enum
+{
+    PPM_ASCII = 3,
+    PPM_GRAY = 5,
+    PPM_RGB = 6
+};
+
+// size of the buffer of the converted samples of a writer
+#define PPM_BUFFER (1 << 20)
+
+/*
+structure of writer of the pixels of an image in a netpbm file
+
+the pixels of a "P6" file with samples of 1 byte are written directly 
+from the lines given by the caller; the other types are converted into 
+'buffer', which is written when it is full
+*/
+typedef struct PpmWriter
+{
+    FILE *g;
+    int format, max_color;
+    unsigned char *buffer;
+    size_t length;
+} PpmWriter;
+
+int parse_format (char *name);
+int read_header (Grid *grid, FILE *f);
+int raw_pixels (Grid *grid);
+int read_pixels (Grid *grid, FILE *f, pixel *pixels, size_t count);
+void open_writer (PpmWriter *writer, FILE *g, int format, int max_color, int width, int height);
+void write_pixels (PpmWriter *writer, const pixel *pixels, size_t count);
+void close_writer (PpmWriter *writer);
+
+#endif
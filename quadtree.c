@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quadtree.h"
+#include "header.h"
+#include "codec.h"
+#include "query.h"
+#include "ppm.h"
+
+/*
+structure of context of the library
+
+tree = nodes array of the last quadtree
+table = summed-area table of the last compressed image
+output, capacity = buffer of the results
+error = reason of the last error
+*/
+struct qt_context
+{
+    QTree tree;
+    SumTable table;
+    unsigned char *output;
+    size_t capacity;
+    char error[128];
+};
+
+// the codes of the transforms are the ones of the TRANSFORM_* constants
+_Static_assert((int) QT_FLIP_V == TRANSFORM_V &&
+               (int) QT_FLIP_H == TRANSFORM_H &&
+               (int) QT_TRANSPOSE == TRANSFORM_T &&
+               (int) QT_ROTATE_90 == TRANSFORM_90 &&
+               (int) QT_ROTATE_180 == TRANSFORM_180 &&
+               (int) QT_ROTATE_270 == TRANSFORM_270,
+               "the transforms of quadtree.h and header.h differ");
+
+/*
+structure of index of a compressed file of the library
+*/
+struct qt_index
+{
+    Index index;
+};
+
+/*
+function used to record the reason of an error of a context and return
+-1
+*/
+static int fail (qt_context *ctx, const char *reason)
+{
+    snprintf(ctx->error, sizeof(ctx->error), "%s", reason);
+
+    return -1;
+}
+
+/*
+function used to make sure the output buffer of a context can store at
+least 'length' bytes
+*/
+static void reserve_output (qt_context *ctx, size_t length)
+{
+    if(length <= ctx->capacity)
+        return;
+
+    ctx->output = (unsigned char *) realloc(ctx->output, length);
+    ctx->capacity = length;
+}
+
+/*
+function used to create a context with empty buffers; returns NULL if
+there is not enough memory
+*/
+qt_context *qt_create (void)
+{
+    qt_context *ctx = (qt_context *) malloc(sizeof(qt_context));
+
+    if(ctx == NULL)
+        return NULL;
+
+    init_QTree(&ctx->tree);
+    init_sum_table(&ctx->table);
+    ctx->output = NULL;
+    ctx->capacity = 0;
+    ctx->error[0] = '\0';
+
+    return ctx;
+}
+
+/*
+function used to free a context and its buffers
+*/
+void qt_destroy (qt_context *ctx)
+{
+    if(ctx == NULL)
+        return;
+
+    free_QTree(&ctx->tree);
+    free_sum_table(&ctx->table);
+    free(ctx->output);
+    free(ctx);
+}
+
+/*
+function used to find the reason of the last error of a context
+*/
+const char *qt_error (qt_context *ctx)
+{
+    return ctx->error;
+}
+
+/*
+function used to find the format of the compressed files given by the
+flags of a call; returns -1 if more than one format is selected
+*/
+static int flags_format (qt_context *ctx, int flags)
+{
+    if((flags & QT_COMPACT) && (flags & QT_PROGRESSIVE))
+        return fail(ctx, "QT_COMPACT cannot be used with QT_PROGRESSIVE");
+
+    if(flags & QT_COMPACT)
+        return FORMAT_COMPACT;
+    if(flags & QT_PROGRESSIVE)
+        return FORMAT_LEVELS;
+
+    return FORMAT_LEGACY;
+}
+
+/*
+function used to compress the pixels matrix of an image in the output
+buffer of a context
+*/
+static int encode_grid (qt_context *ctx, Grid *grid, int factor, int flags, const unsigned char **out, size_t *length)
+{
+    int format = flags_format(ctx, flags);
+
+    if(format < 0)
+        return -1;
+
+    // the quadtree starts empty, but keeps its nodes array, and the
+    // image is in the top-left corner of its square
+    ctx->tree.nodes = 0;
+    ctx->tree.leaves = 0;
+    ctx->tree.line = 0;
+    ctx->tree.column = 0;
+
+    build_sum_table(&ctx->table, grid);
+    build_QTree_c(&ctx->tree, &ctx->table, 0, 0, 
+                  quadtree_size(grid->width, grid->height), factor);
+
+    (*length) = pack_QTree(&ctx->tree, grid->width, grid->height, format,
+                           &ctx->output, &ctx->capacity);
+    (*out) = ctx->output;
+
+    return 0;
+}
+
+/*
+function used to compress a .ppm image stored in a buffer; the pixels
+of an 8-bit "P6" image are read directly from the buffer, the other ones
+are converted in a temporary pixels matrix
+*/
+int qt_encode (qt_context *ctx, const unsigned char *ppm, size_t size, int factor, int flags, const unsigned char **out, size_t *length)
+{
+    int result = 0;
+    long offset = 0;
+    Grid grid, converted;
+    FILE *f = NULL;
+
+    // the header is read by the same function as the one of the files
+    f = (size > 0) ? fmemopen((void *) ppm, size, "rb") : NULL;
+    if(f == NULL)
+        return fail(ctx, "the image is empty");
+
+    if(read_header(&grid, f) != 0)
+    {
+        fclose(f);
+        return fail(ctx, "the image is not a valid .ppm image");
+    }
+
+    if(!raw_pixels(&grid))
+    {
+        alloc_grid(&converted, grid.width, grid.height);
+        result = read_pixels(&grid, f, converted.pixels, 
+                             (size_t) grid.width * grid.height);
+        fclose(f);
+
+        if(result == 0)
+            result = encode_grid(ctx, &converted, factor, flags, out, 
+                                 length);
+        else
+            result = fail(ctx, "the image is not a valid .ppm image");
+        free_grid(&converted);
+
+        return result;
+    }
+
+    offset = ftell(f);
+    fclose(f);
+
+    if(size - offset < (size_t) grid.width * grid.height * sizeof(pixel))
+        return fail(ctx, "the image is not a valid .ppm image");
+
+    grid.pixels = (pixel *) (ppm + offset);
+    grid.stride = grid.width;
+    grid.data = NULL;
+    grid.mapped = 0;
+    grid.tile = 0;
+
+    return encode_grid(ctx, &grid, factor, flags, out, length);
+}
+
+/*
+function used to compress an image given by its pixels, without a .ppm
+header
+*/
+int qt_encode_rgb (qt_context *ctx, const unsigned char *rgb, int width, int height, int stride, int factor, int flags, const unsigned char **out, size_t *length)
+{
+    Grid grid;
+
+    if(stride == 0)
+        stride = width;
+    if(width <= 0 || height <= 0 || width > (1 << QT_MAX_LEVEL) || 
+       height > (1 << QT_MAX_LEVEL) || stride < width)
+        return fail(ctx, "the dimensions of the image are not valid");
+
+    grid.pixels = (pixel *) rgb;
+    grid.width = width;
+    grid.height = height;
+    grid.stride = stride;
+    grid.format = PPM_RGB;
+    grid.max_color = 255;
+    grid.data = NULL;
+    grid.mapped = 0;
+    grid.tile = 0;
+
+    return encode_grid(ctx, &grid, factor, flags, out, length);
+}
+
+/*
+function used to read the quadtree of a compressed file stored in a
+buffer, in the legacy or the compact format
+*/
+static int load_data (qt_context *ctx, const unsigned char *data, size_t size, int *width, int *height)
+{
+    int result = 0;
+    FILE *f = (size > 0) ? fmemopen((void *) data, size, "rb") : NULL;
+
+    if(f == NULL)
+        return fail(ctx, "the compressed file is empty");
+
+    result = load_QTree(&ctx->tree, f, width, height);
+    fclose(f);
+
+    if(result != 0)
+        return fail(ctx, "the compressed file is not valid");
+
+    return 0;
+}
+
+/*
+function used to render the image of a compressed file, reduced 2^shift
+times, after 'offset' bytes of the output buffer of a context
+*/
+static int render_data (qt_context *ctx, const unsigned char *data, size_t size, int shift, size_t offset, View *view)
+{
+    int width = 0, height = 0;
+
+    if(load_data(ctx, data, size, &width, &height) != 0)
+        return -1;
+
+    init_view(view, &ctx->tree, width, height, (shift > 0) ? shift : 0);
+
+    // the lines are rendered directly in the output buffer
+    reserve_output(ctx, offset + (size_t) view->width * view->height * 
+                        sizeof(pixel));
+    render_lines(&ctx->tree, view, view->line, view->height, 
+                 (pixel *) (ctx->output + offset));
+
+    return 0;
+}
+
+/*
+function used to decompress a compressed file stored in a buffer, as a
+.ppm image
+*/
+int qt_decode (qt_context *ctx, const unsigned char *data, size_t size, int shift, const unsigned char **ppm, size_t *length)
+{
+    char header[50];
+    int count = 0, width = 0, height = 0;
+    View view;
+
+    // the dimensions of the image are only known after the quadtree
+    // is read, so the header is written after its pixels are rendered
+    // (in the space of the longest header)
+    if(render_data(ctx, data, size, shift, sizeof(header), &view) != 0)
+        return -1;
+
+    width = view.width;
+    height = view.height;
+    count = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, 
+                     height);
+    memcpy(ctx->output + sizeof(header) - count, header, count);
+
+    (*ppm) = ctx->output + sizeof(header) - count;
+    (*length) = count + (size_t) width * height * sizeof(pixel);
+
+    return 0;
+}
+
+/*
+function used to decompress a compressed file stored in a buffer, as the
+pixels of the image
+*/
+int qt_decode_rgb (qt_context *ctx, const unsigned char *data, size_t size, int shift, const unsigned char **rgb, int *width, int *height)
+{
+    View view;
+
+    if(render_data(ctx, data, size, shift, 0, &view) != 0)
+        return -1;
+
+    (*rgb) = ctx->output;
+    (*width) = view.width;
+    (*height) = view.height;
+
+    return 0;
+}
+
+/*
+function used to transform the image of a compressed file stored in a
+buffer and write the compressed file of the result; the codes of the
+transforms are the ones of the TRANSFORM_* constants
+*/
+int qt_transform (qt_context *ctx, const unsigned char *data, size_t size, int type, int flags, const unsigned char **out, size_t *length)
+{
+    int width = 0, height = 0, format = flags_format(ctx, flags);
+
+    if(format < 0)
+        return -1;
+    if(type < 0 || type >= TRANSFORMS)
+        return fail(ctx, "unknown transform");
+
+    if(load_data(ctx, data, size, &width, &height) != 0)
+        return -1;
+
+    transform_image(&ctx->tree, type, &width, &height);
+
+    (*length) = pack_QTree(&ctx->tree, width, height, format, 
+                           &ctx->output, &ctx->capacity);
+    (*out) = ctx->output;
+
+    return 0;
+}
+
+/*
+function used to open the index of a compressed file for random-access
+queries; the index is closed with qt_close_index
+*/
+int qt_open_index (qt_context *ctx, const char *path, qt_index **index)
+{
+    FILE *f = fopen(path, "rb");
+    qt_index *result = NULL;
+
+    if(f == NULL)
+        return fail(ctx, "cannot open the compressed file");
+
+    result = (qt_index *) malloc(sizeof(qt_index));
+    if(result == NULL)
+    {
+        fclose(f);
+        return fail(ctx, "not enough memory");
+    }
+
+    // the mapping of the file stays valid after the file is closed
+    if(open_index(&result->index, f) != 0)
+    {
+        free(result);
+        fclose(f);
+        return fail(ctx, "the compressed file is not valid");
+    }
+    fclose(f);
+
+    *index = result;
+
+    return 0;
+}
+
+/*
+function used to close the index of a compressed file
+*/
+void qt_close_index (qt_index *index)
+{
+    if(index == NULL)
+        return;
+
+    close_index(&index->index);
+    free(index);
+}
+
+/*
+function used to find the dimensions of the image of an index
+*/
+void qt_index_size (qt_index *index, int *width, int *height)
+{
+    *width = index->index.width;
+    *height = index->index.height;
+}
+
+/*
+function used to find the colours of a batch of pixels of the image of
+an index; 'points' stores the column and the line of every pixel, and
+their colours are written in 'rgb', 3 bytes for each pixel (black for 
+the pixels outside the image)
+*/
+int qt_query_points (qt_index *index, const int *points, size_t count, unsigned char *rgb)
+{
+    int result = 0;
+    size_t i = 0;
+    pixel colour;
+
+    for(i = 0; i < count; i++)
+    {
+        if(points[2 * i] < 0 || points[2 * i] >= index->index.width || 
+           points[2 * i + 1] < 0 || 
+           points[2 * i + 1] >= index->index.height)
+        {
+            colour.red = colour.green = colour.blue = 0;
+            result = -1;
+        }
+        else
+            query_point(&index->index, points[2 * i + 1], points[2 * i],
+                        &colour);
+
+        rgb[3 * i] = colour.red;
+        rgb[3 * i + 1] = colour.green;
+        rgb[3 * i + 2] = colour.blue;
+    }
+
+    return result;
+}
+
+/*
+function used to find the mean colours of the pixels of the image of an
+index inside a rectangle
+*/
+int qt_query_rect (qt_index *index, int x, int y, int width, int height, unsigned char *rgb)
+{
+    pixel colour;
+
+    if(width <= 0 || height <= 0 || 
+       query_rect(&index->index, y, x, height, width, &colour) == 0)
+        return -1;
+
+    rgb[0] = colour.red;
+    rgb[1] = colour.green;
+    rgb[2] = colour.blue;
+
+    return 0;
+}
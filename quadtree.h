@@ -0,0 +1,82 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+#include <stddef.h>
+
+/*
+library of the compression tool ("libquadtree.a" and "libquadtree.so")
+
+the images and the compressed files are passed in memory buffers of the
+caller, which are only read; the results are written in a buffer of the
+context, which stays valid until the next call with the same context
+(it must not be freed by the caller)
+
+a context keeps the nodes array, the summed-area table and the output
+buffer between calls, so compressing images of similar sizes does not
+allocate memory again; a context is used by a single thread at a time,
+but different threads can use different contexts
+
+the pixels of an image without its .ppm header ("rgb") are stored line
+by line, 3 bytes (red, green, blue) for each pixel; the lines of an input
+image start 'stride' pixels after each other (0 if they follow each 
+other directly); the .ppm images given to qt_encode can also be "P3" or
+"P5" images, or have samples of 2 bytes, which are converted to 8 bits
+
+every function returns 0 on success and -1 on error; qt_error gives the
+reason of the last error of a context
+*/
+typedef struct qt_context qt_context;
+
+// only the functions of this header are exported by the shared library
+#define QT_API __attribute__ ((visibility ("default")))
+
+/*
+index of a compressed file on disk, for random-access queries of the
+colours of its pixels ("-q"); the legacy and the progressive files are
+mapped in memory and only the nodes on the path to a pixel are read, so
+opening a large file costs no time and no memory
+
+an index is only read after it is opened, so the same index can be used
+by several threads at a time; a point or a rectangle is given by its 
+column (x), its line (y) and its size, and the colours of a rectangle
+are the mean ones of its pixels; the queries return -1 if a point or 
+the whole rectangle is outside the image
+*/
+typedef struct qt_index qt_index;
+
+// write the compressed file in the compact format ("-z")
+#define QT_COMPACT 1
+// write the compressed file in the progressive format ("-p"); any prefix
+// of such a file can be decoded
+#define QT_PROGRESSIVE 2
+
+/*
+geometric transforms of an image (the same ones as the ones of "-x");
+the rotations are clockwise
+*/
+enum
+{
+    QT_FLIP_V,
+    QT_FLIP_H,
+    QT_TRANSPOSE,
+    QT_ROTATE_90,
+    QT_ROTATE_180,
+    QT_ROTATE_270
+};
+
+QT_API qt_context *qt_create (void);
+QT_API void qt_destroy (qt_context *ctx);
+QT_API const char *qt_error (qt_context *ctx);
+
+QT_API int qt_encode (qt_context *ctx, const unsigned char *ppm, size_t size, int factor, int flags, const unsigned char **out, size_t *length);
+QT_API int qt_encode_rgb (qt_context *ctx, const unsigned char *rgb, int width, int height, int stride, int factor, int flags, const unsigned char **out, size_t *length);
+QT_API int qt_decode (qt_context *ctx, const unsigned char *data, size_t size, int shift, const unsigned char **ppm, size_t *length);
+QT_API int qt_decode_rgb (qt_context *ctx, const unsigned char *data, size_t size, int shift, const unsigned char **rgb, int *width, int *height);
+QT_API int qt_transform (qt_context *ctx, const unsigned char *data, size_t size, int type, int flags, const unsigned char **out, size_t *length);
+
+QT_API int qt_open_index (qt_context *ctx, const char *path, qt_index **index);
+QT_API void qt_close_index (qt_index *index);
+QT_API void qt_index_size (qt_index *index, int *width, int *height);
+QT_API int qt_query_points (qt_index *index, const int *points, size_t count, unsigned char *rgb);
+QT_API int qt_query_rect (qt_index *index, int x, int y, int width, int height, unsigned char *rgb);
+
+#endif
@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "query.h"
+#include "codec.h"
+
+/*
+function used to set the nodes and the dimensions of the image of an
+index from a memory mapped legacy file; returns 0 on success and -1 if
+the file is not valid
+*/
+static int map_legacy (Index *index)
+{
+    /*
+        the dimensions are read from the dimensions record, if the file
+        ends with one; otherwise the image is a square whose area is the
+        one of the root, so the nodes array is never scanned
+    */
+
+    uint32_t nodes = 0, dimensions[4] = {0, 0, 0, 0};
+    size_t record = 0;
+    unsigned long long area = 0;
+    size_t end = 0;
+
+    memcpy(&nodes, index->data + 4, sizeof(uint32_t));
+    if(nodes == 0 || nodes > (index->data_size - 8) / sizeof(QuadtreeNode))
+        return -1;
+
+    index->nodes = (const QuadtreeNode *) (index->data + 8);
+    index->count = nodes;
+
+    // a moved image also records its line and its column
+    end = 8 + (size_t) nodes * sizeof(QuadtreeNode);
+    if(index->data_size > end + 4 && 
+       memcmp(index->data + end, QTD_MAGIC, 4) == 0)
+        record = 2 * sizeof(uint32_t);
+    else if(index->data_size > end + 4 && 
+            memcmp(index->data + end, QTO_MAGIC, 4) == 0)
+        record = 4 * sizeof(uint32_t);
+    if(record > 0 && index->data_size == end + 4 + record)
+    {
+        memcpy(dimensions, index->data + end + 4, record);
+        if(dimensions[0] == 0 || dimensions[0] > (1u << QT_MAX_LEVEL) ||
+           dimensions[1] == 0 || dimensions[1] > (1u << QT_MAX_LEVEL) ||
+           check_origin(dimensions[2], dimensions[3], dimensions[0], 
+                        dimensions[1]) != 0)
+            return -1;
+
+        index->width = dimensions[0];
+        index->height = dimensions[1];
+        index->line = dimensions[2];
+        index->column = dimensions[3];
+        return 0;
+    }
+
+    area = index->nodes[0].area;
+    if(area == 0 || area > (1ull << (2 * QT_MAX_LEVEL)))
+        return -1;
+    index->width = sqrt(area);
+    index->height = index->width;
+    if((unsigned long long) index->width * index->width != area ||
+       quadtree_size(index->width, index->height) != index->width)
+        return -1;
+
+    return 0;
+}
+
+/*
+function used to set the nodes and the dimensions of the image of an
+index from a memory mapped progressive file, which may end before its
+last node; returns 0 on success and -1 if the file is not valid
+*/
+static int map_levels (Index *index)
+{
+    uint32_t header[7] = {0, 0, 0, 0, 0, 0, 0};
+    size_t start = 0, fields = 5;
+
+    // a moved image also records its line and its column
+    if(index->data_size > 4 && index->data[4] == QTL_MOVED)
+        fields = 7;
+    if(index->data_size < 5 + fields * sizeof(uint32_t) || 
+       (index->data[4] != QTL_VERSION && index->data[4] != QTL_MOVED))
+        return -1;
+
+    memcpy(header, index->data + 5, fields * sizeof(uint32_t));
+    start = 5 + fields * sizeof(uint32_t) + 
+            (size_t) header[4] * sizeof(uint32_t);
+    if(header[0] == 0 || header[0] > (1u << QT_MAX_LEVEL) || 
+       header[1] == 0 || header[1] > (1u << QT_MAX_LEVEL) ||
+       check_origin(header[5], header[6], header[0], header[1]) != 0 ||
+       header[2] == 0 || header[4] == 0 || header[4] > QT_MAX_LEVEL + 1 ||
+       index->data_size < start + sizeof(QuadtreeNode))
+        return -1;
+
+    // only the nodes that were received are used
+    index->nodes = (const QuadtreeNode *) (index->data + start);
+    index->count = (index->data_size - start) / sizeof(QuadtreeNode);
+    if(index->count > header[2])
+        index->count = header[2];
+    index->width = header[0];
+    index->height = header[1];
+    index->line = header[5];
+    index->column = header[6];
+
+    return 0;
+}
+
+/*
+function used to open the index of a compressed file, in any format;
+returns 0 on success and -1 if the file is not valid
+*/
+int open_index (Index *index, FILE *f)
+{
+    struct stat info;
+    void *map = MAP_FAILED;
+    int result = 0;
+
+    index->nodes = NULL;
+    index->count = 0;
+    index->line = 0;
+    index->column = 0;
+    index->data = NULL;
+    index->data_size = 0;
+    init_QTree(&index->tree);
+
+    // map regular files in memory; the nodes are only read
+    if(fstat(fileno(f), &info) == 0 && S_ISREG(info.st_mode) && 
+       info.st_size >= 8)
+        map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+
+    if(map != MAP_FAILED && memcmp(map, QTZ_MAGIC, 4) != 0)
+    {
+        index->data = (unsigned char *) map;
+        index->data_size = info.st_size;
+
+        if(memcmp(map, QTL_MAGIC, 4) == 0)
+            result = map_levels(index);
+        else
+            result = map_legacy(index);
+    }
+    else
+    {
+        // the compact format has no child indices, so its nodes
+        // are decoded in memory
+        if(map != MAP_FAILED)
+            munmap(map, info.st_size);
+
+        result = load_QTree(&index->tree, f, &index->width, &index->height);
+        index->nodes = index->tree.node_vector;
+        index->count = index->tree.nodes;
+        index->line = index->tree.line;
+        index->column = index->tree.column;
+    }
+
+    if(result != 0)
+    {
+        close_index(index);
+        return -1;
+    }
+
+    index->size = quadtree_size(index->width, index->height);
+
+    return 0;
+}
+
+/*
+function used to close the index of a compressed file
+*/
+void close_index (Index *index)
+{
+    if(index->data != NULL)
+        munmap(index->data, index->data_size);
+
+    free_QTree(&index->tree);
+    index->data = NULL;
+    index->nodes = NULL;
+    index->count = 0;
+}
+
+/*
+function used to find the child of a node that covers a quarter of its
+block (0 = top-left, 1 = top-right, 2 = bottom-right, 3 = bottom-left);
+returns -1 if the child is not in the nodes array, as for the nodes of a
+progressive file that were not received, so the node is used as a leaf
+*/
+static int32_t find_child (Index *index, const QuadtreeNode *node, int k)
+{
+    int32_t child = node->top_left;
+
+    if(k == 1)
+        child = node->top_right;
+    else if(k == 2)
+        child = node->bottom_right;
+    else if(k == 3)
+        child = node->bottom_left;
+
+    if(child <= 0 || (uint32_t) child >= index->count)
+        return -1;
+
+    return child;
+}
+
+/*
+function used to find the colours of the pixel at a line and a column of
+the image, following the child indices from the root along the path to
+the pixel; the blocks are in the coordinates of the image, so the root 
+starts at the position of the image in its square
+*/
+void query_point (Index *index, int line, int column, pixel *colour)
+{
+    /*
+        every step halves the block, so even a damaged nodes array gives
+        a path with at most QT_MAX_LEVEL steps
+    */
+
+    int x = -index->line, y = -index->column, size = index->size;
+    int k = 0, i = 0;
+    int32_t child = 0;
+    const QuadtreeNode *node = &index->nodes[0];
+
+    while(size > 1 && node->top_left != -1)
+    {
+        size = size / 2;
+        if(line < x + size)
+            k = (column < y + size) ? 0 : 1;
+        else
+            k = (column < y + size) ? 3 : 2;
+
+        // a node with a child that is not in the nodes array is a
+        // leaf node, as in a decoded prefix of a progressive file
+        for(i = 0; i < 4; i++)
+            if(find_child(index, node, i) < 0)
+                break;
+        if(i < 4)
+            break;
+        child = find_child(index, node, k);
+
+        if(line >= x + size)
+            x = x + size;
+        if(column >= y + size)
+            y = y + size;
+        node = &index->nodes[child];
+    }
+
+    colour->red = node->red;
+    colour->green = node->green;
+    colour->blue = node->blue;
+}
+
+/*
+function used to find the mean colours of the pixels of the image inside
+a rectangle; only the nodes whose blocks cross its edges are divided, so
+a rectangle that is a block of the quadtree is found in as many steps as
+a single pixel; returns the number of pixels of the image inside the
+rectangle (0 if there is none)
+*/
+uint64_t query_rect (Index *index, int line, int column, int lines, int columns, pixel *colour)
+{
+    int top = 0, bottom = 0, left = 0, right = 0, count = 0, k = 0;
+    int end_line = 0, end_column = 0, half = 0;
+    int32_t child[4];
+    uint64_t area = 0, total = 0, red = 0, green = 0, blue = 0;
+    const QuadtreeNode *node = NULL;
+    Pending stack[QT_STACK], b;
+
+    // keep the part of the rectangle that is inside the image
+    bottom = ((long long) line + lines < index->height) ? line + lines 
+                                                        : index->height;
+    right = ((long long) column + columns < index->width) ? column + columns
+                                                          : index->width;
+    line = (line > 0) ? line : 0;
+    column = (column > 0) ? column : 0;
+
+    // the blocks are in the coordinates of the image
+    stack[count++] = (Pending) {-index->line, -index->column, index->size, 
+                                0, -1, 0};
+    while(count > 0)
+    {
+        b = stack[--count];
+        node = &index->nodes[b.index];
+
+        // part of the block inside the rectangle
+        top = (b.x > line) ? b.x : line;
+        left = (b.y > column) ? b.y : column;
+        end_line = (b.x + b.size < bottom) ? b.x + b.size : bottom;
+        end_column = (b.y + b.size < right) ? b.y + b.size : right;
+        if(top >= end_line || left >= end_column)
+            continue;
+        area = (uint64_t) (end_line - top) * (end_column - left);
+
+        // a block that is inside the rectangle (or a leaf node) 
+        // gives its mean colours to all of its pixels
+        for(k = 0; k < 4; k++)
+            child[k] = (node->top_left == -1 || b.size == 1) ? -1 : 
+                       find_child(index, node, k);
+        if(area == block_area(b.x, b.y, b.size, index->width, 
+                              index->height) || 
+           child[0] < 0 || child[1] < 0 || child[2] < 0 || child[3] < 0)
+        {
+            red = red + area * node->red;
+            green = green + area * node->green;
+            blue = blue + area * node->blue;
+            total = total + area;
+            continue;
+        }
+
+        half = b.size / 2;
+        stack[count++] = (Pending) {b.x, b.y, half, child[0], -1, 0};
+        stack[count++] = (Pending) {b.x, b.y + half, half, child[1], -1, 0};
+        stack[count++] = (Pending) {b.x + half, b.y + half, half, child[2],
+                                    -1, 0};
+        stack[count++] = (Pending) {b.x + half, b.y, half, child[3], -1, 0};
+    }
+
+    if(total > 0)
+    {
+        colour->red = (red + total / 2) / total;
+        colour->green = (green + total / 2) / total;
+        colour->blue = (blue + total / 2) / total;
+    }
+
+    return total;
+}
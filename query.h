@@ -0,0 +1,36 @@
+#ifndef QUERY_H
+#define QUERY_H
+#include "header.h"
+
+/*
+structure of index of a compressed file, used to find the colours of 
+single pixels or rectangles of the image without building its quadtree 
+or rendering it ("-q" argument)
+
+the legacy and the progressive files are memory mapped and their nodes
+are read in place, following the child indices from the root; a compact
+file (or an input that cannot be mapped) is decoded in 'tree' first
+
+nodes, count = nodes array (in the mapping or in 'tree')
+width, height = dimensions of the image
+size = side length of the square covered by the quadtree
+line, column = position of the image in the square (see "QTree")
+data, data_size = memory mapping of the file (NULL if it is not mapped)
+*/
+typedef struct Index
+{
+    const QuadtreeNode *nodes;
+    uint32_t count;
+    int width, height, size;
+    int line, column;
+    unsigned char *data;
+    size_t data_size;
+    QTree tree;
+} Index;
+
+int open_index (Index *index, FILE *f);
+void close_index (Index *index);
+void query_point (Index *index, int line, int column, pixel *colour);
+uint64_t query_rect (Index *index, int line, int column, int lines, int columns, pixel *colour);
+
+#endif
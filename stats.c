@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+// names of the phases, in the order of their constants
+static const char *phase_name[PHASES] =
+{
+    "read", "table", "tree", "flip", "load", "render", "write"
+};
+
+/*
+function used to find the current time in milliseconds
+*/
+static double now_ms (void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+/*
+function used to initialize the statistics of an operation
+*/
+void init_stats (Stats *stats, int enabled)
+{
+    memset(stats, 0, sizeof(Stats));
+    stats->enabled = enabled;
+
+    if(enabled)
+        stats->start = now_ms();
+}
+
+/*
+function used to find the time when a phase starts (0 if the statistics
+are not collected)
+*/
+double stats_clock (Stats *stats)
+{
+    if(!stats->enabled)
+        return 0;
+
+    return now_ms();
+}
+
+/*
+function used to add the time since 'start' to a phase
+*/
+void stats_phase (Stats *stats, int phase, double start)
+{
+    if(!stats->enabled)
+        return;
+
+    stats->phase[phase] = stats->phase[phase] + (now_ms() - start);
+}
+
+/*
+function used to count the leaf nodes of a quadtree at each depth
+*/
+static void count_depth (Stats *stats, QTree *tree)
+{
+    int top = 0;
+    QuadtreeNode *node = NULL;
+    Pending stack[QT_STACK], b;
+
+    // 'size' stores the depth of the node
+    stack[top++] = (Pending) {0, 0, 0, 0, -1, 0};
+    while(top > 0)
+    {
+        b = stack[--top];
+        node = &tree->node_vector[b.index];
+
+        if(node->top_left == -1 || b.size == QT_MAX_LEVEL)
+        {
+            stats->depth[b.size]++;
+            continue;
+        }
+
+        stack[top++] = (Pending) {0, 0, b.size + 1, node->top_left, -1, 0};
+        stack[top++] = (Pending) {0, 0, b.size + 1, node->top_right, -1, 0};
+        stack[top++] = (Pending) {0, 0, b.size + 1, node->bottom_right, 
+                                  -1, 0};
+        stack[top++] = (Pending) {0, 0, b.size + 1, node->bottom_left, 
+                                  -1, 0};
+    }
+}
+
+/*
+function used to record the numbers of nodes and the depths of the leaf
+nodes of a quadtree
+*/
+void stats_tree (Stats *stats, QTree *tree)
+{
+    if(!stats->enabled || tree->nodes == 0)
+        return;
+
+    stats->nodes = tree->nodes;
+    stats->leaves = tree->leaves;
+    memset(stats->depth, 0, sizeof(stats->depth));
+    count_depth(stats, tree);
+}
+
+/*
+function used to find the size of a file: the size of a regular file,
+or the current position for the others (for example, pipes)
+*/
+static uint64_t file_size (FILE *f)
+{
+    struct stat info;
+
+    fflush(f);
+    if(fstat(fileno(f), &info) == 0 && S_ISREG(info.st_mode))
+        return info.st_size;
+
+    return ftello(f) < 0 ? 0 : ftello(f);
+}
+
+/*
+function used to record the sizes of the input and output files
+*/
+void stats_files (Stats *stats, FILE *in, FILE *out)
+{
+    if(!stats->enabled)
+        return;
+
+    stats->bytes_in = file_size(in);
+    stats->bytes_out = file_size(out);
+}
+
+/*
+function used to copy a string to a buffer, escaping the characters that
+are not allowed inside a JSON string; longer strings are truncated
+*/
+static void escape_json (const char *s, char *out, size_t size)
+{
+    size_t i = 0;
+
+    for(; *s != '\0' && i + 2 < size; s++)
+    {
+        if(*s == '"' || *s == '\\')
+            out[i++] = '\\';
+        if((unsigned char) *s >= 0x20)
+            out[i++] = *s;
+    }
+    out[i] = '\0';
+}
+
+/*
+function used to print the statistics of an operation as a single line
+with a JSON object, on the standard error
+*/
+void print_stats (Stats *stats, const char *operation, const char *input)
+{
+    int i = 0, last = 0;
+    char name[1024], line[4096];
+    size_t length = 0;
+    struct rusage usage;
+
+    if(!stats->enabled)
+        return;
+
+    getrusage(RUSAGE_SELF, &usage);
+    escape_json(input, name, sizeof(name));
+
+    length += snprintf(line + length, sizeof(line) - length,
+                       "{\"operation\": \"%s\", \"input\": \"%s\", "
+                       "\"total_ms\": %.3f", operation, name,
+                       now_ms() - stats->start);
+    for(i = 0; i < PHASES; i++)
+        length += snprintf(line + length, sizeof(line) - length,
+                           ", \"%s_ms\": %.3f", phase_name[i],
+                           stats->phase[i]);
+
+    length += snprintf(line + length, sizeof(line) - length,
+                       ", \"bytes_in\": %llu, \"bytes_out\": %llu, "
+                       "\"ratio\": %.3f, \"nodes\": %u, \"leaves\": %u, "
+                       "\"depth\": [",
+                       (unsigned long long) stats->bytes_in,
+                       (unsigned long long) stats->bytes_out,
+                       stats->bytes_out > 0 ?
+                       (double) stats->bytes_in / stats->bytes_out : 0.0,
+                       stats->nodes, stats->leaves);
+
+    // leaf nodes at each depth, up to the deepest one
+    for(i = 0; i < 32; i++)
+        if(stats->depth[i] != 0)
+            last = i;
+    for(i = 0; i <= last; i++)
+        length += snprintf(line + length, sizeof(line) - length, "%s%u",
+                           i == 0 ? "" : ", ", stats->depth[i]);
+
+    // the peak resident memory is given in kilobytes
+    snprintf(line + length, sizeof(line) - length,
+             "], \"peak_rss_kb\": %ld}\n", usage.ru_maxrss);
+
+    // a single call, so the lines of different threads are not mixed
+    fputs(line, stderr);
+}
@@ -0,0 +1,48 @@
+#ifndef STATS_H
+#define STATS_H
+#include "header.h"
+
+/*
+phases of an operation that are timed separately
+*/
+enum
+{
+    PHASE_READ,
+    PHASE_TABLE,
+    PHASE_TREE,
+    PHASE_FLIP,
+    PHASE_LOAD,
+    PHASE_RENDER,
+    PHASE_WRITE,
+    PHASES
+};
+
+/*
+structure of the statistics of an operation ("--stats" option)
+
+enabled = 0 if the statistics are not collected; then every function
+          returns immediately, without reading the clock
+start = time when the operation started, in milliseconds
+phase = time spent in each phase, in milliseconds
+bytes_in, bytes_out = sizes of the input and output files
+nodes, leaves = numbers of nodes and leaf nodes of the quadtree
+depth[d] = number of leaf nodes at depth d (the root has depth 0)
+*/
+typedef struct Stats
+{
+    int enabled;
+    double start;
+    double phase[PHASES];
+    uint64_t bytes_in, bytes_out;
+    uint32_t nodes, leaves;
+    uint32_t depth[32];
+} Stats;
+
+void init_stats (Stats *stats, int enabled);
+double stats_clock (Stats *stats);
+void stats_phase (Stats *stats, int phase, double start);
+void stats_tree (Stats *stats, QTree *tree);
+void stats_files (Stats *stats, FILE *in, FILE *out);
+void print_stats (Stats *stats, const char *operation, const char *input);
+
+#endif
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../quadtree.h"
+
+/*
+tests of the library ("make check"); every test prints its name and
+returns the number of its failures
+*/
+
+/*
+function used to copy the result of a call, which is only valid until
+the next call with the same context
+*/
+static unsigned char *copy (const unsigned char *data, size_t length)
+{
+    unsigned char *result = (unsigned char *) malloc(length);
+
+    memcpy(result, data, length);
+
+    return result;
+}
+
+/*
+function used to find the pixel of an image that goes to line i and 
+column j of its transform (width and height of the original image)
+*/
+static const unsigned char *source (const unsigned char *rgb, int width, int height, int type, int i, int j)
+{
+    int line = i, column = j;
+
+    if(type == QT_FLIP_V)
+        line = height - 1 - i;
+    else if(type == QT_FLIP_H)
+        column = width - 1 - j;
+    else if(type == QT_TRANSPOSE)
+    {
+        line = j;
+        column = i;
+    }
+    else if(type == QT_ROTATE_90)
+    {
+        line = height - 1 - j;
+        column = i;
+    }
+    else if(type == QT_ROTATE_180)
+    {
+        line = height - 1 - i;
+        column = width - 1 - j;
+    }
+    else if(type == QT_ROTATE_270)
+    {
+        line = j;
+        column = width - 1 - i;
+    }
+
+    return rgb + 3 * ((size_t) line * width + column);
+}
+
+/*
+test of the transforms of a non-square image: the transform of the 
+compressed file is decoded to exactly the same pixels as the transform
+of its decoded image
+*/
+static int test_transform (qt_context *ctx)
+{
+    int width = 100, height = 37, w = 0, h = 0, i = 0, j = 0, type = 0;
+    int failures = 0, wrong = 0, flags = 0;
+    unsigned char *image = (unsigned char *) malloc(3 * width * height);
+    unsigned char *data = NULL, *decoded = NULL;
+    const unsigned char *out = NULL;
+    size_t length = 0;
+
+    // a gradient with some noise, so the leaves are not uniform
+    srand(1);
+    for(i = 0; i < width * height; i++)
+    {
+        image[3 * i] = (i % width) * 2 + rand() % 4;
+        image[3 * i + 1] = (i / width) * 6 + rand() % 4;
+        image[3 * i + 2] = 128 + rand() % 4;
+    }
+
+    for(flags = 0; flags <= QT_PROGRESSIVE; flags++)
+    {
+        qt_encode_rgb(ctx, image, width, height, 0, 10, flags, &out, 
+                      &length);
+        data = copy(out, length);
+        qt_decode_rgb(ctx, data, length, 0, &out, &w, &h);
+        decoded = copy(out, 3 * (size_t) w * h);
+
+        for(type = QT_FLIP_V; type <= QT_ROTATE_270; type++)
+        {
+            const unsigned char *result = NULL;
+            size_t size = 0;
+
+            if(qt_transform(ctx, data, length, type, flags, &result, 
+                            &size) != 0)
+            {
+                printf("transform %d: %s\n", type, qt_error(ctx));
+                failures++;
+                continue;
+            }
+            // the nodes are only permuted, so the file only grows by
+            // the line and the column of the moved image
+            if(size > length + 2 * sizeof(uint32_t))
+            {
+                printf("transform %d (flags %d): %zu bytes instead of %zu\n",
+                       type, flags, size, length);
+                failures++;
+            }
+
+            unsigned char *transformed = copy(result, size);
+            qt_decode_rgb(ctx, transformed, size, 0, &out, &w, &h);
+
+            wrong = 0;
+            for(i = 0; i < h; i++)
+                for(j = 0; j < w; j++)
+                    if(memcmp(out + 3 * ((size_t) i * w + j), 
+                              source(decoded, width, height, type, i, j), 
+                              3) != 0)
+                        wrong++;
+
+            if(wrong > 0)
+            {
+                printf("transform %d (flags %d): %d pixels differ\n", type,
+                       flags, wrong);
+                failures++;
+            }
+            free(transformed);
+        }
+
+        free(decoded);
+        free(data);
+    }
+
+    free(image);
+    printf("transform: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    return failures;
+}
+
+/*
+function used to add a node to a legacy compressed file stored in a 
+buffer (colours, area and child indices, -1 for a leaf node)
+*/
+static size_t put_node (unsigned char *data, size_t length, int colour, uint32_t area, int32_t first)
+{
+    int32_t child[4] = {-1, -1, -1, -1};
+    int k = 0;
+
+    if(first != -1)
+        for(k = 0; k < 4; k++)
+            child[k] = first + k;
+
+    memset(data + length, colour, 3);
+    memcpy(data + length + 3, &area, 4);
+    memcpy(data + length + 7, child, sizeof(child));
+
+    return length + 23;
+}
+
+/*
+function used to build a legacy compressed file of a 2x2 image: the root,
+its four children and, if 'deep' is set, four children of the first one
+(blocks smaller than a pixel); 'area' is the area of the second child
+and 2 - area the one of the third one, so the areas of the leaf nodes
+always add up to the area of the image
+*/
+static size_t legacy_file (unsigned char *data, int deep, uint32_t area)
+{
+    uint32_t leaves = deep ? 7 : 4, nodes = deep ? 9 : 5;
+    size_t length = 8;
+    int k = 0;
+
+    memcpy(data, &leaves, 4);
+    memcpy(data + 4, &nodes, 4);
+    length = put_node(data, length, 100, 4, 1);
+    length = put_node(data, length, 10, 1, deep ? 5 : -1);
+    length = put_node(data, length, 20, area, -1);
+    length = put_node(data, length, 30, 2 - area, -1);
+    length = put_node(data, length, 40, 1, -1);
+    for(k = 0; deep && k < 4; k++)
+        length = put_node(data, length, 50, (k == 0) ? 1 : 0, -1);
+
+    return length;
+}
+
+/*
+function used to build a progressive compressed file whose header claims
+'nodes' nodes of a 32768x32768 image, on a single level, followed by a 
+node with children that are not the next nodes
+*/
+static size_t levels_file (unsigned char *data, uint32_t nodes)
+{
+    uint32_t header[6] = {32768, 32768, nodes, 1, 1, 0};
+    size_t length = 5;
+
+    memcpy(data, "\x89QTL", 4);
+    data[4] = 1;
+    memcpy(data + length, header, sizeof(header));
+    length = length + sizeof(header);
+
+    return put_node(data, length, 60, 1, 5);
+}
+
+/*
+test of the legacy files that are not the quadtree of their image: they
+are rejected by every function that reads a compressed file
+*/
+static int test_malformed (qt_context *ctx)
+{
+    unsigned char data[256];
+    const unsigned char *out = NULL;
+    size_t length = 0, size = 0;
+    uint32_t nodes = 0;
+    int failures = 0, flags = 0;
+    qt_context *fresh = NULL;
+
+    // a valid file, for reference
+    length = legacy_file(data, 0, 1);
+    if(qt_decode(ctx, data, length, 0, &out, &size) != 0)
+    {
+        printf("malformed: the valid file is rejected (%s)\n", 
+               qt_error(ctx));
+        failures++;
+    }
+
+    // a quadtree deeper than the one of the image, then a node with
+    // an area that is not the one of its block
+    length = legacy_file(data, 1, 1);
+    if(qt_decode(ctx, data, length, 0, &out, &size) == 0)
+        failures++;
+    for(flags = 0; flags <= QT_PROGRESSIVE; flags++)
+        if(qt_transform(ctx, data, length, QT_FLIP_V, flags, &out, 
+                        &size) == 0)
+            failures++;
+
+    length = legacy_file(data, 0, 2);
+    if(qt_decode(ctx, data, length, 0, &out, &size) == 0)
+        failures++;
+
+    // an image moved outside the square of its quadtree
+    uint32_t origin[4] = {2, 2, 1, 0};
+    length = legacy_file(data, 0, 1);
+    memcpy(data + length, "\x89QTO", 4);
+    memcpy(data + length + 4, origin, sizeof(origin));
+    length = length + 4 + sizeof(origin);
+    if(qt_decode(ctx, data, length, 0, &out, &size) == 0 ||
+       qt_transform(ctx, data, length, QT_FLIP_V, 0, &out, &size) == 0)
+        failures++;
+
+    // headers that claim far more nodes than the file stores: they are
+    // rejected without allocating the nodes array they claim (a new
+    // context has no nodes array yet)
+    legacy_file(data, 0, 1);
+    nodes = 0xFFFFFFF0;
+    memcpy(data + 4, &nodes, 4);
+    fresh = qt_create();
+    if(qt_decode(fresh, data, 100, 0, &out, &size) == 0 ||
+       qt_transform(fresh, data, 100, QT_FLIP_V, 0, &out, &size) == 0)
+        failures++;
+    qt_destroy(fresh);
+
+    length = levels_file(data, 1400000000);
+    fresh = qt_create();
+    if(qt_decode(fresh, data, length, 0, &out, &size) == 0 ||
+       qt_transform(fresh, data, length, QT_FLIP_V, 0, &out, &size) == 0)
+        failures++;
+    qt_destroy(fresh);
+
+    printf("malformed: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    return failures;
+}
+
+int main (void)
+{
+    int failures = 0;
+    qt_context *ctx = qt_create();
+
+    failures += test_transform(ctx);
+    failures += test_malformed(ctx);
+
+    qt_destroy(ctx);
+
+    return (failures == 0) ? 0 : 1;
+}